@@ -3,20 +3,164 @@
 // Core
 #include <iostream>
 #include <string>
+#include <vector>
 #include "tchar.h"
 #include <regex>
 
-// Blegh.  Need to replace this later with a better UTF8 converter.
-#include <windows.h>
-
 // Custom
 #include <fbx_importer.h>
 #include <db_converter.h>
+#include <tt_options.h>
+#include <batch_converter.h>
+#include <conversion_cache.h>
+#include <tt_utf8.h>
 
 //using namespace FbxSdk;
 
 const std::wregex dbRegex(L".*\\.db$");
 
+/**
+ * Runs a single conversion, picking the direction from the file extension.
+ * With a cache directory set, a result cached for the same input and options is used
+ * instead, and new results are added to the cache.
+ * Returns the conversion's status code, which is also what the process exits with.
+ */
+int Convert(const std::wstring& path, const TTOptions& options, FbxManager* manager) {
+	std::wcmatch m;
+	bool isDb = std::regex_match(path.c_str(), m, dbRegex);
+
+	if (options.CacheDir.empty()) {
+		if (!isDb) {
+			FBXImporter fbxImporter;
+			return fbxImporter.ImportFBX(path, options, manager);
+		}
+		else {
+			DBConverter dbConverter;
+			return dbConverter.ConvertDB(path, options, manager);
+		}
+	}
+
+	// The cache needs to know where the result goes.
+	TTOptions cachedOptions = options;
+	cachedOptions.CacheDir.clear();
+	if (cachedOptions.Output.empty()) {
+		cachedOptions.Output = isDb ? L"result.fbx" : L"result.db";
+	}
+
+	ConversionCache cache(options.CacheDir, (uint64_t)options.CacheSize * 1024 * 1024, options.CacheLink);
+	std::wstring key = cache.GetKey(path, cachedOptions, isDb ? L".fbx" : L".db");
+	if (!key.empty() && cache.Fetch(key, cachedOptions.Output)) {
+		fprintf(stdout, "Using cached result for: %ls\n", path.c_str());
+		cache.PrintStats();
+		return 0;
+	}
+
+	// An earlier hit may have left the output hardlinked to a cache entry.  That's safe,
+	// as both converters remove (or move aside) an existing output before writing theirs.
+	int code = Convert(path, cachedOptions, manager);
+	if (code == 0 && !key.empty()) {
+		cache.Store(key, cachedOptions.Output);
+	}
+	cache.PrintStats();
+	return code;
+}
+
+/**
+ * Server mode.  Keeps one FBX manager alive and runs a conversion for every line on stdin,
+ * until a blank line or the end of input.  Each line is a file path, optionally followed by
+ * the usual options, separated by tabs.  Once a conversion is done, a status line of
+ * "@status <code>" goes to stdout, where the code means the same as the normal exit code.
+ */
+int RunServer() {
+	FbxManager* manager = FbxManager::Create();
+
+	FbxIOSettings* ios = FbxIOSettings::Create(manager, IOSROOT);
+	manager->SetIOSettings(ios);
+
+	FbxString lPath = FbxGetApplicationDirectory();
+	manager->LoadPluginsDirectory(lPath.Buffer());
+
+	std::string line;
+	while (std::getline(std::cin, line)) {
+		if (!line.empty() && line.back() == '\r') {
+			line.pop_back();
+		}
+		if (line.empty()) {
+			break;
+		}
+
+		// Split the job into its path and options.
+		std::wstring job = utf8_decode(line);
+		std::vector<std::wstring> args;
+		size_t start = 0;
+		while (start <= job.size()) {
+			size_t end = job.find(L'\t', start);
+			if (end == std::wstring::npos) {
+				end = job.size();
+			}
+			args.push_back(job.substr(start, end - start));
+			start = end + 1;
+		}
+
+		std::vector<wchar_t*> argv;
+		for (unsigned int i = 0; i < args.size(); i++) {
+			argv.push_back(&args[i][0]);
+		}
+
+		int code;
+		TTOptions options;
+		if (!options.Parse((int)argv.size(), argv.data(), 1)) {
+			fprintf(stderr, "Invalid command line option.\n");
+			code = 106;
+		}
+		else {
+			// The converters catch their own errors, but the client needs a status line regardless.
+			try {
+				code = Convert(args[0], options, manager);
+			}
+			catch (std::exception& e) {
+				fprintf(stderr, "\nCritical Error: %s\n", e.what());
+				code = _TT_Unhandled_Error;
+			}
+			catch (...) {
+				fprintf(stderr, "\nCritical Error: Unknown error.\n");
+				code = _TT_Unhandled_Error;
+			}
+		}
+
+		fflush(stderr);
+		fprintf(stdout, "@status %d\n", code);
+		fflush(stdout);
+	}
+
+	manager->Destroy();
+	return 0;
+}
+
+/**
+ * Batch mode.  Converts every input named in argv[2] onward, up to the first option,
+ * on a pool of threads that each set up their own FBX manager.
+ */
+int RunBatch(int argc, wchar_t* argv[]) {
+	BatchConverter batch([](const std::wstring& path, const TTOptions& options) {
+		return Convert(path, options, NULL);
+	});
+
+	int i = 2;
+	for (; i < argc && argv[i][0] != L'-'; i++) {
+		if (!batch.AddInput(argv[i])) {
+			fprintf(stderr, "No files matched: %ls\n", argv[i]);
+		}
+	}
+
+	TTOptions options;
+	if (!options.Parse(argc, argv, i)) {
+		fprintf(stderr, "Invalid command line option.\n");
+		return(106);
+	}
+
+	return batch.Run(options);
+}
 
 /**
  * Program entry point, yaaaay.
@@ -28,17 +172,19 @@ int wmain(int argc, wchar_t* argv[], wchar_t* envp[])
 		return(101);
 	}
 
-	wchar_t* base = argv[1];
-
-	std::wcmatch m;
 	std::wstring arg = argv[1];
-	bool success = std::regex_match(arg.c_str(), m, dbRegex);
-	if (!success) {
-		FBXImporter* fbxImporter = new FBXImporter();
-		return fbxImporter->ImportFBX(arg);
+	if (arg == L"--server") {
+		return RunServer();
+	}
+	if (arg == L"--batch") {
+		return RunBatch(argc, argv);
 	}
-	else {
-		DBConverter* dbConverter = new DBConverter();
-		return dbConverter->ConvertDB(arg);
+
+	TTOptions options;
+	if (!options.Parse(argc, argv, 2)) {
+		fprintf(stderr, "Invalid command line option.\n");
+		return(106);
 	}
-}
\ No newline at end of file
+
+	return Convert(arg, options, NULL);
+}
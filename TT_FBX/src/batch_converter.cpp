@@ -0,0 +1,325 @@
+#include <batch_converter.h>
+
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cwctype>
+#include <stdio.h>
+
+// Custom
+#include <tt_utf8.h>
+#include <tt_error.h>
+
+namespace fs = std::filesystem;
+
+// Case-insensitive, like the file system.
+static std::wstring ToLower(std::wstring str) {
+	for (unsigned int i = 0; i < str.size(); i++) {
+		str[i] = (wchar_t)std::towlower(str[i]);
+	}
+	return str;
+}
+
+static bool IsConvertible(const fs::path& path) {
+	std::wstring ext = ToLower(path.extension().wstring());
+	return ext == L".fbx" || ext == L".db";
+}
+
+// Matches a file name against a pattern of * (any run of characters) and ? (any one character).
+static bool MatchWildcard(const wchar_t* pattern, const wchar_t* name) {
+	const wchar_t* star = NULL;
+	const wchar_t* resume = NULL;
+	while (*name) {
+		if (*pattern == L'*') {
+			star = pattern++;
+			resume = name;
+		}
+		else if (*pattern == L'?' || std::towlower(*pattern) == std::towlower(*name)) {
+			pattern++;
+			name++;
+		}
+		else if (star) {
+			pattern = star + 1;
+			name = ++resume;
+		}
+		else {
+			return false;
+		}
+	}
+	while (*pattern == L'*') {
+		pattern++;
+	}
+	return *pattern == 0;
+}
+
+// Case-folded full path, for telling whether two names refer to the same file.
+static std::wstring PathKey(const fs::path& path) {
+	std::error_code ec;
+	fs::path canonical = fs::weakly_canonical(path, ec);
+	return ToLower(ec ? path.wstring() : canonical.wstring());
+}
+
+BatchConverter::BatchConverter(ConvertFunction convertFunction) {
+	convert = convertFunction;
+}
+
+bool BatchConverter::AddFile(const std::wstring& path) {
+	if (!added.insert(PathKey(path)).second) {
+		return true;
+	}
+
+	TTBatchJob job;
+	job.Input = path;
+
+	std::error_code ec;
+	job.Bytes = fs::file_size(path, ec);
+	if (ec) {
+		job.Bytes = 0;
+	}
+
+	jobs.push_back(job);
+	return true;
+}
+
+bool BatchConverter::AddPattern(const std::wstring& pattern) {
+	fs::path path(pattern);
+	std::wstring name = path.filename().wstring();
+	fs::path dir = path.parent_path();
+	if (dir.empty()) {
+		dir = L".";
+	}
+
+	std::vector<std::wstring> matches;
+	std::error_code ec;
+	for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+		if (!it->is_regular_file(ec)) {
+			continue;
+		}
+		std::wstring file = it->path().filename().wstring();
+		if (MatchWildcard(name.c_str(), file.c_str()) && IsConvertible(it->path())) {
+			matches.push_back(it->path().wstring());
+		}
+	}
+
+	// Directory order isn't guaranteed, and it decides the summary order and output names.
+	std::sort(matches.begin(), matches.end());
+	for (unsigned int i = 0; i < matches.size(); i++) {
+		AddFile(matches[i]);
+	}
+	return !matches.empty();
+}
+
+bool BatchConverter::AddListFile(const std::wstring& path) {
+	std::ifstream file{ fs::path(path) };
+	if (!file) {
+		return false;
+	}
+
+	bool matched = false;
+	std::string line;
+	while (std::getline(file, line)) {
+		if (!line.empty() && line.back() == '\r') {
+			line.pop_back();
+		}
+		if (line.empty()) {
+			continue;
+		}
+		if (AddInput(utf8_decode(line))) {
+			matched = true;
+		}
+		else {
+			fprintf(stderr, "No files matched: %s\n", line.c_str());
+		}
+	}
+	return matched;
+}
+
+bool BatchConverter::AddInput(const std::wstring& input) {
+	if (input.size() > 1 && input[0] == L'@') {
+		return AddListFile(input.substr(1));
+	}
+
+	if (input.find_first_of(L"*?") != std::wstring::npos) {
+		return AddPattern(input);
+	}
+
+	std::error_code ec;
+	if (fs::is_directory(input, ec)) {
+		bool fbx = AddPattern((fs::path(input) / L"*.fbx").wstring());
+		bool db = AddPattern((fs::path(input) / L"*.db").wstring());
+		return fbx || db;
+	}
+
+	if (!fs::exists(input, ec)) {
+		return false;
+	}
+	return AddFile(input);
+}
+
+/**
+ * Names each job's result after its input, with the other extension, in the output directory.
+ * Names that are already taken, by another job's result or by any of the inputs, get a numbered
+ * suffix, so no job writes over a file another job writes or reads.
+ */
+void BatchConverter::AssignOutputs(const std::wstring& outputDir) {
+	fs::path dir = outputDir.empty() ? fs::path(L".") : fs::path(outputDir);
+	std::set<std::wstring> used(added.begin(), added.end());
+
+	for (unsigned int i = 0; i < jobs.size(); i++) {
+		fs::path input(jobs[i].Input);
+		std::wstring stem = input.stem().wstring();
+		std::wstring ext = ToLower(input.extension().wstring()) == L".db" ? L".fbx" : L".db";
+
+		fs::path output = dir / (stem + ext);
+		for (int n = 2; used.count(PathKey(output)); n++) {
+			output = dir / (stem + L"_" + std::to_wstring(n) + ext);
+		}
+		used.insert(PathKey(output));
+
+		jobs[i].Output = output.wstring();
+	}
+}
+
+/**
+ * Worker loop.  Runs jobs off the front of its own queue until that's empty, then steals
+ * from the back of the other queues, where the smaller jobs are.  No jobs are added once
+ * the workers start, so finding every queue empty means the batch is done.
+ */
+void BatchConverter::Work(std::vector<WorkQueue>& queues, int worker, const TTOptions& options) {
+	int queueCount = (int)queues.size();
+	while (true) {
+		int index = -1;
+		{
+			WorkQueue& own = queues[worker];
+			std::lock_guard<std::mutex> lock(own.Mutex);
+			if (!own.Jobs.empty()) {
+				index = own.Jobs.front();
+				own.Jobs.pop_front();
+			}
+		}
+
+		for (int i = 1; index < 0 && i < queueCount; i++) {
+			WorkQueue& victim = queues[(worker + i) % queueCount];
+			std::lock_guard<std::mutex> lock(victim.Mutex);
+			if (!victim.Jobs.empty()) {
+				index = victim.Jobs.back();
+				victim.Jobs.pop_back();
+			}
+		}
+
+		if (index < 0) {
+			return;
+		}
+
+		TTBatchJob& job = jobs[index];
+		TTOptions jobOptions = options;
+		jobOptions.Output = job.Output;
+
+		auto start = std::chrono::steady_clock::now();
+		try {
+			job.Code = convert(job.Input, jobOptions);
+		}
+		catch (...) {
+			// One bad file shouldn't take the rest of the batch down with it.
+			fprintf(stderr, "Unhandled error converting: %ls\n", job.Input.c_str());
+			job.Code = _TT_Unhandled_Error;
+		}
+		job.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+int BatchConverter::Run(const TTOptions& options) {
+	if (jobs.empty()) {
+		fprintf(stderr, "No files to convert.\n");
+		return 101;
+	}
+
+	if (!options.OutputDir.empty()) {
+		std::error_code ec;
+		fs::create_directories(options.OutputDir, ec);
+		if (ec) {
+			fprintf(stderr, "Unable to create output directory.\n");
+			return 107;
+		}
+	}
+	AssignOutputs(options.OutputDir);
+
+	int workerCount = options.Jobs;
+	if (workerCount == 0) {
+		workerCount = (int)std::thread::hardware_concurrency();
+	}
+	workerCount = std::max(1, std::min(workerCount, (int)jobs.size()));
+
+	// Deal the jobs out largest first, so each queue runs its big files early,
+	// and whatever is left to steal near the end is small.
+	std::vector<int> order(jobs.size());
+	for (unsigned int i = 0; i < order.size(); i++) {
+		order[i] = i;
+	}
+	std::stable_sort(order.begin(), order.end(), [this](int a, int b) {
+		return jobs[a].Bytes > jobs[b].Bytes;
+	});
+
+	std::vector<WorkQueue> queues(workerCount);
+	for (unsigned int i = 0; i < order.size(); i++) {
+		queues[i % workerCount].Jobs.push_back(order[i]);
+	}
+
+	fprintf(stdout, "Converting %d files on %d threads.\n", (int)jobs.size(), workerCount);
+	fflush(stdout);
+
+	auto start = std::chrono::steady_clock::now();
+	if (workerCount == 1) {
+		Work(queues, 0, options);
+	}
+	else {
+		std::vector<std::thread> workers;
+		for (int i = 0; i < workerCount; i++) {
+			workers.emplace_back(&BatchConverter::Work, this, std::ref(queues), i, std::cref(options));
+		}
+		for (unsigned int i = 0; i < workers.size(); i++) {
+			workers[i].join();
+		}
+	}
+	double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	PrintSummary(wallSeconds);
+
+	for (unsigned int i = 0; i < jobs.size(); i++) {
+		if (jobs[i].Code != 0) {
+			return jobs[i].Code;
+		}
+	}
+	return 0;
+}
+
+void BatchConverter::PrintSummary(double wallSeconds) {
+	const double megabyte = 1024.0 * 1024.0;
+
+	double totalMb = 0;
+	int failures = 0;
+
+	fprintf(stdout, "\nBatch summary:\n");
+	for (unsigned int i = 0; i < jobs.size(); i++) {
+		const TTBatchJob& job = jobs[i];
+		double mb = job.Bytes / megabyte;
+		double rate = job.Seconds > 0 ? mb / job.Seconds : 0;
+		totalMb += mb;
+
+		if (job.Code != 0) {
+			failures++;
+			fprintf(stdout, "  FAIL %3d  %8.2fs  %9.2f MB  %8.2f MB/s  %ls\n", job.Code, job.Seconds, mb, rate, job.Input.c_str());
+		}
+		else {
+			fprintf(stdout, "  OK        %8.2fs  %9.2f MB  %8.2f MB/s  %ls -> %ls\n", job.Seconds, mb, rate, job.Input.c_str(), job.Output.c_str());
+		}
+	}
+
+	double mbRate = wallSeconds > 0 ? totalMb / wallSeconds : 0;
+	double fileRate = wallSeconds > 0 ? jobs.size() / wallSeconds : 0;
+	fprintf(stdout, "%d files, %d failed, %.2f MB in %.2fs: %.2f MB/s, %.2f files/s\n",
+		(int)jobs.size(), failures, totalMb, wallSeconds, mbRate, fileRate);
+	fflush(stdout);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+// Core
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <functional>
+#include <set>
+#include <cstdint>
+
+// Custom
+#include <tt_options.h>
+
+// A single file in a batch, and how its conversion went.
+class TTBatchJob {
+public:
+	std::wstring Input;
+	std::wstring Output;
+
+	// Size of the input file, used to schedule the biggest files first.
+	uintmax_t Bytes = 0;
+
+	// The conversion's status code, same as the normal exit code.
+	int Code = 0;
+	double Seconds = 0;
+};
+
+// Converts a list of .fbx and .db files on a pool of worker threads.
+// Jobs are dealt out largest first, and a worker that runs out of its own jobs
+// steals from the back of the others' queues, so one huge file doesn't hold up the rest.
+class BatchConverter {
+public:
+	// Runs one conversion, writing to options.Output.  Each call must set up its own FBX manager.
+	typedef std::function<int(const std::wstring& path, const TTOptions& options)> ConvertFunction;
+
+	BatchConverter(ConvertFunction convertFunction);
+
+	// Adds the files an input argument names: a file, a directory (all .fbx and .db files in it),
+	// a wildcard pattern on the file name (* and ?), or @listfile with one of these per line.
+	// Returns false if nothing matched.
+	bool AddInput(const std::wstring& input);
+
+	// Converts every file added so far into options.OutputDir, then prints a summary.
+	// Returns 0 if all went well, or the first failing file's code, in input order.
+	int Run(const TTOptions& options);
+
+private:
+	// One queue per worker.  The owner takes from the front, thieves from the back.
+	class WorkQueue {
+	public:
+		std::mutex Mutex;
+		std::deque<int> Jobs;
+	};
+
+	ConvertFunction convert;
+	std::vector<TTBatchJob> jobs;
+
+	// Files already added, so overlapping inputs only convert each file once.
+	std::set<std::wstring> added;
+
+	bool AddFile(const std::wstring& path);
+	bool AddPattern(const std::wstring& pattern);
+	bool AddListFile(const std::wstring& path);
+	void AssignOutputs(const std::wstring& outputDir);
+	void Work(std::vector<WorkQueue>& queues, int worker, const TTOptions& options);
+	void PrintSummary(double wallSeconds);
+};
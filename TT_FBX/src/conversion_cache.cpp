@@ -0,0 +1,229 @@
+#include <conversion_cache.h>
+
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <functional>
+#include <stdio.h>
+
+// Custom
+#include <tt_hash.h>
+#include <tt_utf8.h>
+#include <db_converter.h>
+
+namespace fs = std::filesystem;
+
+std::mutex ConversionCache::mutex;
+
+// Hit/miss counts, kept alongside the results so they add up across runs.
+static const wchar_t* statsFile = L"stats.txt";
+
+// Hashes a file's size and contents.  Returns false if it couldn't be read.
+static bool HashFile(TTHash64& hash, const fs::path& path) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file) {
+		return false;
+	}
+
+	std::vector<char> chunk(1 << 20);
+	uint64_t size = 0;
+	while (file) {
+		file.read(chunk.data(), chunk.size());
+		hash.Update(chunk.data(), (size_t)file.gcount());
+		size += (uint64_t)file.gcount();
+	}
+	hash.UpdateValue(size);
+	return !file.bad();
+}
+
+ConversionCache::ConversionCache(const std::wstring& directory, uint64_t maxBytes, bool hardLink) {
+	this->directory = directory;
+	this->maxBytes = maxBytes;
+	this->hardLink = hardLink;
+
+	std::error_code ec;
+	fs::create_directories(this->directory, ec);
+}
+
+std::wstring ConversionCache::GetKey(const std::wstring& input, const TTOptions& options, const std::wstring& outputExtension) {
+	TTHash64 hash;
+	if (!HashFile(hash, fs::path(input))) {
+		return std::wstring();
+	}
+
+	// FBX exports embed the textures the DB's materials point to, so those go in too.
+	// A texture that's missing is hashed as such, since the export just leaves it out.
+	if (outputExtension == L".fbx") {
+		std::vector<std::string> textures;
+		if (!DBConverter::ReadTexturePaths(input, textures)) {
+			return std::wstring();
+		}
+		for (unsigned int i = 0; i < textures.size(); i++) {
+			hash.UpdateString(textures[i]);
+			bool found = HashFile(hash, fs::path(utf8_decode(textures[i])));
+			hash.UpdateValue((uint8_t)found);
+		}
+	}
+
+	// Only the options that change the output go in.  Threads and MemoryDb don't.
+	hash.UpdateValue((uint32_t)_TT_Cache_Version);
+	hash.UpdateValue((uint8_t)options.FuseConversion);
+	hash.UpdateValue((uint8_t)options.ColumnarDb);
+	hash.UpdateValue((int32_t)options.MaxWeights);
+
+	wchar_t name[17];
+	swprintf(name, 17, L"%016llx", (unsigned long long)hash.Digest());
+	return name + outputExtension;
+}
+
+bool ConversionCache::Fetch(const std::wstring& key, const std::wstring& output) {
+	fs::path entry = directory / key;
+	std::error_code ec;
+
+	bool found = fs::exists(entry, ec);
+	if (found) {
+		fs::remove(output, ec);
+
+		ec.clear();
+		if (hardLink) {
+			fs::create_hard_link(entry, output, ec);
+		}
+		if (!hardLink || ec) {
+			ec.clear();
+			fs::copy_file(entry, output, fs::copy_options::overwrite_existing, ec);
+		}
+		found = !ec;
+
+		// The entry's modified time doubles as its last use, for trimming.
+		if (found) {
+			fs::last_write_time(entry, fs::file_time_type::clock::now(), ec);
+		}
+	}
+
+	CountLookup(found);
+	return found;
+}
+
+void ConversionCache::Store(const std::wstring& key, const std::wstring& output) {
+	fs::path entry = directory / key;
+	std::error_code ec;
+
+	// Copy under a name of our own, then move it into place, so nobody ever
+	// fetches a half-written entry.
+	std::wstring suffix = std::to_wstring(std::hash<std::thread::id>()(std::this_thread::get_id()));
+	fs::path temp = directory / (key + L".tmp" + suffix);
+	fs::copy_file(output, temp, fs::copy_options::overwrite_existing, ec);
+	if (!ec) {
+		fs::rename(temp, entry, ec);
+	}
+	if (ec) {
+		fprintf(stderr, "Warning: Unable to add result to the cache: %s\n", ec.message().c_str());
+		fs::remove(temp, ec);
+		return;
+	}
+
+	Trim();
+}
+
+// Removes the least recently used entries until the cache fits in maxBytes.
+void ConversionCache::Trim() {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	struct Entry {
+		fs::path Path;
+		fs::file_time_type LastUsed;
+		uintmax_t Bytes;
+	};
+
+	std::vector<Entry> entries;
+	uintmax_t total = 0;
+	std::error_code ec;
+	for (fs::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec)) {
+		std::wstring ext = it->path().extension().wstring();
+		if (!it->is_regular_file(ec) || (ext != L".db" && ext != L".fbx")) {
+			continue;
+		}
+
+		Entry entry;
+		entry.Path = it->path();
+		entry.LastUsed = it->last_write_time(ec);
+		entry.Bytes = it->file_size(ec);
+		total += entry.Bytes;
+		entries.push_back(entry);
+	}
+
+	if (total <= maxBytes) {
+		return;
+	}
+
+	std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+		return a.LastUsed < b.LastUsed;
+	});
+
+	int evicted = 0;
+	for (unsigned int i = 0; i < entries.size() && total > maxBytes; i++) {
+		if (fs::remove(entries[i].Path, ec)) {
+			total -= entries[i].Bytes;
+			evicted++;
+		}
+	}
+	fprintf(stdout, "Cache: Evicted %d least recently used results.\n", evicted);
+}
+
+void ConversionCache::ReadCounts(uint64_t& hits, uint64_t& misses) {
+	hits = 0;
+	misses = 0;
+
+	std::ifstream file(directory / statsFile);
+	std::string name;
+	uint64_t value;
+	while (file >> name >> value) {
+		if (name == "hits") {
+			hits = value;
+		}
+		else if (name == "misses") {
+			misses = value;
+		}
+	}
+}
+
+void ConversionCache::CountLookup(bool hit) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	uint64_t hits, misses;
+	ReadCounts(hits, misses);
+	if (hit) {
+		hits++;
+	}
+	else {
+		misses++;
+	}
+
+	std::ofstream file(directory / statsFile, std::ios::trunc);
+	file << "hits " << hits << "\nmisses " << misses << "\n";
+}
+
+void ConversionCache::PrintStats() {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	uint64_t hits, misses;
+	ReadCounts(hits, misses);
+
+	int entries = 0;
+	uintmax_t total = 0;
+	std::error_code ec;
+	for (fs::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec)) {
+		std::wstring ext = it->path().extension().wstring();
+		if (it->is_regular_file(ec) && (ext == L".db" || ext == L".fbx")) {
+			entries++;
+			total += it->file_size(ec);
+		}
+	}
+
+	uint64_t lookups = hits + misses;
+	double rate = lookups > 0 ? 100.0 * hits / lookups : 0;
+	const double megabyte = 1024.0 * 1024.0;
+	fprintf(stdout, "Cache: %llu hits, %llu misses (%.1f%% hit rate), %d results, %.2f of %.2f MB.\n",
+		(unsigned long long)hits, (unsigned long long)misses, rate, entries, total / megabyte, maxBytes / megabyte);
+}
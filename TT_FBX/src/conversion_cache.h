@@ -0,0 +1,49 @@
+#pragma once
+
+// Core
+#include <string>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+
+// Custom
+#include <tt_options.h>
+
+// Bump whenever a change alters what the converter outputs for the same input,
+// so results cached by older builds are never served.
+#define _TT_Cache_Version 4
+
+// A directory of finished conversions, named by a hash of the input file's contents
+// (and, for DBs, the textures they embed) and everything else that decides the output.  Results are copied (or hardlinked)
+// straight into place on a hit, and the least recently used are trimmed once the
+// directory grows past its size limit.
+// Any failure here just means a miss; the cache never fails a conversion.
+class ConversionCache {
+public:
+	ConversionCache(const std::wstring& directory, uint64_t maxBytes, bool hardLink);
+
+	// Gets the key for converting the given file to the given output extension.
+	// Returns an empty string if the file, or the DB's texture list, couldn't be read.
+	std::wstring GetKey(const std::wstring& input, const TTOptions& options, const std::wstring& outputExtension);
+
+	// Puts the cached result for the key at output.  Returns false on a miss.
+	bool Fetch(const std::wstring& key, const std::wstring& output);
+
+	// Adds a finished result to the cache, then trims it down to size.
+	void Store(const std::wstring& key, const std::wstring& output);
+
+	// Prints the hit/miss counts and cache size to stdout.
+	void PrintStats();
+
+private:
+	std::filesystem::path directory;
+	uint64_t maxBytes;
+	bool hardLink;
+
+	// Batch jobs share one cache directory, so its bookkeeping is done one at a time.
+	static std::mutex mutex;
+
+	void CountLookup(bool hit);
+	void ReadCounts(uint64_t& hits, uint64_t& misses);
+	void Trim();
+};
@@ -1,25 +1,93 @@
 #include <db_converter.h>
 
-bool _UseColor2Channel = true;
+// Makes a read-only, immutable SQLite URI for a UTF-8 file path.
+// The DB is never changed while we read it, so SQLite can skip locking and change detection entirely.
+static std::string MakeReadOnlyUri(const std::string& path) {
+	std::string uri = "file:";
+
+	// Drive letter paths need an empty authority in front of them.
+	if (path.size() > 1 && path[1] == ':') {
+		uri += "///";
+	}
+
+	const char* hex = "0123456789ABCDEF";
+	for (unsigned int i = 0; i < path.size(); i++) {
+		unsigned char c = path[i];
+		if (c == '\\') {
+			uri += '/';
+		}
+		else if (c == '%' || c == '?' || c == '#' || c <= ' ') {
+			uri += '%';
+			uri += hex[c >> 4];
+			uri += hex[c & 0xF];
+		}
+		else {
+			uri += c;
+		}
+	}
+
+	return uri + "?mode=ro&immutable=1";
+}
+
+/**
+ * Opens a read-only connection to the DB, set up for reading big tables start to finish:
+ * the whole file memory mapped, a larger page cache, and query_only as a safety net.
+ * Falls back to a plain read-only open if SQLite won't take the URI.
+ */
+static int OpenReadOnly(const std::string& path, sqlite3** conn) {
+	int rc = sqlite3_open_v2(MakeReadOnlyUri(path).c_str(), conn, SQLITE_OPEN_READONLY | SQLITE_OPEN_URI, NULL);
+	if (rc != SQLITE_OK) {
+		sqlite3_close(*conn);
+		rc = sqlite3_open_v2(path.c_str(), conn, SQLITE_OPEN_READONLY, NULL);
+		if (rc != SQLITE_OK) {
+			return rc;
+		}
+	}
+
+	sqlite3_int64 size = 0;
+	sqlite3_stmt* stmt;
+	if (sqlite3_prepare_v2(*conn, "select page_count * page_size from pragma_page_count(), pragma_page_size()", -1, &stmt, NULL) == SQLITE_OK) {
+		if (sqlite3_step(stmt) == SQLITE_ROW) {
+			size = sqlite3_column_int64(stmt, 0);
+		}
+		sqlite3_finalize(stmt);
+	}
+
+	std::string pragmas = "PRAGMA mmap_size = " + std::to_string(size) + "; PRAGMA cache_size = -65536; PRAGMA query_only = 1;";
+	sqlite3_exec(*conn, pragmas.c_str(), NULL, 0, NULL);
+	return SQLITE_OK;
+}
 /**
  * Shuts down the system gracefully.
+ * Returns the code the conversion finished with.
  */
-void DBConverter::Shutdown(int code, const char* errorMessage) {
+int DBConverter::Shutdown(int code, const char* errorMessage) {
 
-	if (errorMessage != NULL) {
+	if (errorMessage != NULL && errorMessage[0] != '\0') {
 		fprintf(stderr, "\nCritical Error: %s\n", errorMessage);
 	}
 
 	// Destroying the manger destroys the scene with it.
-	int whatever = manager->GetDocumentCount();
-	manager->Destroy();
+	// A shared manager lives on for the next conversion, so only our scene goes.
+	if (ownsManager) {
+		manager->Destroy();
+	}
+	else if (scene != NULL) {
+		scene->Destroy();
+	}
+	manager = NULL;
+	scene = NULL;
+
+	if (ownsModel) {
+		delete ttModel;
+	}
+	ttModel = NULL;
 
 	// Good night DB.
 	sqlite3_close(db);
+	db = NULL;
 
-
-	// Time for sleep.
-	exit(code);
+	return code;
 }
 
 
@@ -39,39 +107,60 @@ sqlite3_stmt* DBConverter::MakeSqlStatement(std::string query) {
 	sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, NULL);
 	return stmt;
 }
+
+// Makes an sqlite statement from a string, on a specific connection.
+sqlite3_stmt* DBConverter::MakeSqlStatement(sqlite3* conn, std::string query) {
+	sqlite3_stmt* stmt;
+	sqlite3_prepare_v2(conn, query.c_str(), -1, &stmt, NULL);
+	return stmt;
+}
 /**
  * Attempts to initialize the SQLite Database and FBX scene.
  * Returns 0 on success, non-zero on error.
  */
-int DBConverter::Init(std::wstring dbFilePath) {
+int DBConverter::Init(std::wstring dbFilePath, FbxManager* sharedManager) {
 
 	char* zErrMsg = 0;
 	int rc;
 	fprintf(stdout, "Attempting to process DB File: %s\n", dbFilePath);
 
-	// Create and connect to the database file.
-	rc = sqlite3_open16(dbFilePath.c_str(), &db);
+	// Connect to the database file, read-only.
+	// If that fails for whatever reason, fall back to opening it the old way.
+	rc = OpenReadOnly(utf8_encode(dbFilePath), &db);
+	if (rc) {
+		sqlite3_close(db);
+		rc = sqlite3_open16(dbFilePath.c_str(), &db);
+	}
 	if (rc) {
 		fprintf(stderr, "Failed to connect to database: %ls\n", sqlite3_errmsg(db));
 		sqlite3_close(db);
 		return(103);
 	}
 
-	// Create the FBX SDK manager
-	manager = FbxManager::Create();
+	InitManager(sharedManager);
 
-	FBXSDK_printf("Autodesk FBX SDK version %s\n", manager->GetVersion());
-	//Create an IOSettings object. This object holds all import/export settings.
-	FbxIOSettings* ios = FbxIOSettings::Create(manager, IOSROOT);
-	manager->SetIOSettings(ios);
+	// The scene itself is made by CreateScene(), once the DB has been read.
+	return 0;
+}
 
-	FbxString lPath = FbxGetApplicationDirectory();
-	manager->LoadPluginsDirectory(lPath.Buffer());
+// Create the FBX SDK manager, unless we were handed one that's already set up.
+void DBConverter::InitManager(FbxManager* sharedManager) {
+	if (sharedManager != NULL) {
+		manager = sharedManager;
+		ownsManager = false;
+	}
+	else {
+		manager = FbxManager::Create();
+		ownsManager = true;
 
-	// Create a new scene so that it can be populated by the imported file.
-	(scene) = FbxScene::Create((manager), "TT Export");
+		FBXSDK_printf("Autodesk FBX SDK version %s\n", manager->GetVersion());
+		//Create an IOSettings object. This object holds all import/export settings.
+		FbxIOSettings* ios = FbxIOSettings::Create(manager, IOSROOT);
+		manager->SetIOSettings(ios);
 
-	return 0;
+		FbxString lPath = FbxGetApplicationDirectory();
+		manager->LoadPluginsDirectory(lPath.Buffer());
+	}
 }
 
 // Handles running and error checking the first sqlite step of a statement.
@@ -87,19 +176,19 @@ bool DBConverter::GetRow(sqlite3_stmt* statement) {
 		std::string err = sqlite3_errmsg(db);
 		fprintf(stderr, "SQLite Error: %s", err.c_str());
 		sqlite3_finalize(statement);
-		Shutdown(201, "SQLite Error.");
+		throw TTError(201, "SQLite Error.");
 	}
 }
 
 // Assembles the bone list into a heirarchical skeleton.
-void DBConverter::BuildSkeleton(std::vector<TTBone*> bones) {
+void DBConverter::BuildSkeleton(const std::vector<TTBone*>& bones) {
 
 	TTBone* root = NULL;
 
 	// First, find the root;
 	for (int i = 0; i < bones.size(); i++) {
 		TTBone* bone = bones[i];
-		if (bone->ParentName == "") {
+		if (bone->ParentName < 0) {
 			root = bone;
 			root->Parent = NULL;
 			break;
@@ -110,21 +199,222 @@ void DBConverter::BuildSkeleton(std::vector<TTBone*> bones) {
 		return;
 	}
 
+	// Group the bones by parent name, keeping their order.
+	std::vector<std::vector<TTBone*>> children(ttModel->Names.Size());
+	for (int i = 0; i < bones.size(); i++) {
+		if (bones[i]->ParentName >= 0) {
+			children[bones[i]->ParentName].push_back(bones[i]);
+		}
+	}
+
 	ttModel->FullSkeleton = root;
-	AssignChildren(root, bones);
+	AssignChildren(root, children);
+	ttModel->IndexSkeleton();
+}
+
+// Links every bone below root to its parent.  Bones that can't be reached from root are left out.
+void DBConverter::AssignChildren(TTBone* root, const std::vector<std::vector<TTBone*>>& children) {
+	std::vector<TTBone*> stack;
+	stack.push_back(root);
+	while (!stack.empty()) {
+		TTBone* parent = stack.back();
+		stack.pop_back();
+
+		const std::vector<TTBone*>& parentChildren = children[parent->Name];
+		for (int i = 0; i < parentChildren.size(); i++) {
+			TTBone* bone = parentChildren[i];
+			bone->Parent = parent;
+			parent->Children.push_back(bone);
+			stack.push_back(bone);
+		}
+	}
+}
+
+// Steps a statement on one of the reader connections.
+// Returns 1 for a row, 0 when done, or -1 on error, with the SQLite error in error.
+static int NextRow(sqlite3* conn, sqlite3_stmt* statement, std::string& error) {
+	int result = sqlite3_step(statement);
+	if (result == SQLITE_ROW) {
+		return 1;
+	}
+	else if (result == SQLITE_DONE) {
+		return 0;
+	}
+	error = sqlite3_errmsg(conn);
+	return -1;
+}
 
+/**
+ * Opens a read-only connection of its own to the DB and runs a table reader on it.
+ * Readers run on worker threads, so they report errors back here rather than shutting down.
+ * Returns 0 on success, non-zero on error.
+ */
+int DBConverter::RunReader(int (DBConverter::*reader)(sqlite3* conn, std::string& error), std::string& error) {
+	const char* path = sqlite3_db_filename(db, "main");
+	if (path == NULL || path[0] == 0) {
+		// Nothing to reopen; read on the main connection.
+		return (this->*reader)(db, error);
+	}
+
+	sqlite3* conn;
+	if (OpenReadOnly(path, &conn) != SQLITE_OK) {
+		error = sqlite3_errmsg(conn);
+		sqlite3_close(conn);
+		return 201;
+	}
 
+	int result = (this->*reader)(conn, error);
+	sqlite3_close(conn);
+	return result;
 }
 
-void DBConverter::AssignChildren(TTBone* root, std::vector<TTBone*> bones) {
-	for (int i = 0; i < bones.size(); i++) {
-		TTBone* bone = bones[i];
-		if (bone->ParentName == root->Name) {
-			bone->Parent = root;
-			root->Children.push_back(bone);
-			AssignChildren(bone, bones);
+// Reads the indices of every part from the indices table.
+int DBConverter::ReadIndices(sqlite3* conn, std::string& error) {
+	int rc;
+
+	// Size everything up front.
+	sqlite3_stmt* query = MakeSqlStatement(conn, "select mesh, part, count(*) from indices group by mesh, part");
+	while ((rc = NextRow(conn, query, error)) > 0) {
+		int meshId = sqlite3_column_int(query, 0);
+		int partId = sqlite3_column_int(query, 1);
+		ttModel->MeshGroups[meshId]->Parts[partId]->Indices.reserve(sqlite3_column_int(query, 2));
+	}
+	sqlite3_finalize(query);
+	if (rc < 0) return 201;
+
+	query = MakeSqlStatement(conn, "select mesh, part, index_id, vertex_id from indices order by mesh asc, part asc, index_id asc");
+	while ((rc = NextRow(conn, query, error)) > 0) {
+		int meshId = sqlite3_column_int(query, 0);
+		int partId = sqlite3_column_int(query, 1);
+		int indexId = sqlite3_column_int(query, 2);
+		int vertexId= sqlite3_column_int(query, 3);
+
+		ttModel->MeshGroups[meshId]->Parts[partId]->Indices.push_back(vertexId);
+	}
+	sqlite3_finalize(query);
+	return rc < 0 ? 201 : 0;
+}
+
+// Reads the vertices of every part from the vertices table.
+int DBConverter::ReadVertices(sqlite3* conn, std::string& error) {
+	int rc;
+
+	// Size everything up front, so each part's arrays are only allocated once.
+	sqlite3_stmt* query = MakeSqlStatement(conn, "select mesh, part, count(*) from vertices group by mesh, part");
+	while ((rc = NextRow(conn, query, error)) > 0) {
+		int meshId = sqlite3_column_int(query, 0);
+		int partId = sqlite3_column_int(query, 1);
+		ttModel->MeshGroups[meshId]->Parts[partId]->Vertices.Resize(sqlite3_column_int(query, 2));
+	}
+	sqlite3_finalize(query);
+	if (rc < 0) return 201;
+
+	query = MakeSqlStatement(conn, "select mesh, part, vertex_id, position_x, position_y, position_z, normal_x, normal_y, normal_z, color_r, color_g, color_b, color_a, color2_r, color2_g, color2_b, color2_a, uv_1_u, uv_1_v, uv_2_u, uv_2_v, bone_1_id, bone_1_weight, bone_2_id, bone_2_weight, bone_3_id, bone_3_weight, bone_4_id, bone_4_weight, bone_5_id, bone_5_weight, bone_6_id, bone_6_weight, bone_7_id, bone_7_weight, bone_8_id, bone_8_weight, binormal_x, binormal_y, binormal_z, tangent_x, tangent_y, tangent_z, uv_3_u, uv_3_v, flow_u, flow_v from vertices order by mesh asc, part asc, vertex_id asc");
+	// Rows come part by part, so v counts up through the current part's vertices.
+	TTVertexBuffer* current = NULL;
+	int v = 0;
+	while ((rc = NextRow(conn, query, error)) > 0) {
+		int meshId = sqlite3_column_int(query, 0);
+		int partId = sqlite3_column_int(query, 1);
+		int vertexId = sqlite3_column_int(query, 2);
+
+		TTVertexBuffer& vertices = ttModel->MeshGroups[meshId]->Parts[partId]->Vertices;
+		if (&vertices != current) {
+			current = &vertices;
+			v = 0;
+		}
+		else {
+			v++;
+		}
+		if (v >= vertices.Size()) {
+			continue;
+		}
+
+		for (int c = 0; c < 3; c++) vertices.Positions[v * 3 + c] = (float)sqlite3_column_double(query, 3 + c);
+		for (int c = 0; c < 3; c++) vertices.Normals[v * 3 + c] = (float)sqlite3_column_double(query, 6 + c);
+		for (int c = 0; c < 4; c++) vertices.Colors[0][v * 4 + c] = TTVertexBuffer::PackUnorm8(sqlite3_column_double(query, 9 + c));
+		for (int c = 0; c < 4; c++) vertices.Colors[1][v * 4 + c] = TTVertexBuffer::PackUnorm8(sqlite3_column_double(query, 13 + c));
+		for (int c = 0; c < 2; c++) vertices.UVs[0][v * 2 + c] = (float)sqlite3_column_double(query, 17 + c);
+		for (int c = 0; c < 2; c++) vertices.UVs[1][v * 2 + c] = (float)sqlite3_column_double(query, 19 + c);
+
+		// NULL bone columns are unused weight slots.
+		for (int wi = 0; wi < _TTW_Max_Weights; wi++) {
+			int idColumn = 21 + wi * 2;
+			int boneId = sqlite3_column_type(query, idColumn) == SQLITE_NULL ? -1 : sqlite3_column_int(query, idColumn);
+			vertices.SetWeight(v, wi, boneId, sqlite3_column_double(query, idColumn + 1));
+		}
+
+		for (int c = 0; c < 3; c++) vertices.Binormals[v * 3 + c] = (float)sqlite3_column_double(query, 37 + c);
+		for (int c = 0; c < 3; c++) vertices.Tangents[v * 3 + c] = (float)sqlite3_column_double(query, 40 + c);
+		for (int c = 0; c < 2; c++) vertices.UVs[2][v * 2 + c] = (float)sqlite3_column_double(query, 43 + c);
+		for (int c = 0; c < 2; c++) vertices.Flow[v * 2 + c] = (float)sqlite3_column_double(query, 45 + c);
+	}
+	sqlite3_finalize(query);
+	return rc < 0 ? 201 : 0;
+}
+
+// Reads the indices and vertices of every part from the streams table.
+int DBConverter::ReadStreams(sqlite3* conn, std::string& error) {
+	int rc;
+	sqlite3_stmt* query = MakeSqlStatement(conn, "select mesh, part, stream, count, data from streams order by mesh asc, part asc");
+	while ((rc = NextRow(conn, query, error)) > 0) {
+		int meshId = sqlite3_column_int(query, 0);
+		int partId = sqlite3_column_int(query, 1);
+		std::string name = std::string(reinterpret_cast<const char*>(sqlite3_column_text(query, 2)));
+		int count = sqlite3_column_int(query, 3);
+		const unsigned char* data = (const unsigned char*)sqlite3_column_blob(query, 4);
+		int bytes = sqlite3_column_bytes(query, 4);
+
+		int stream = GetStreamType(name.c_str());
+		if (stream < 0) {
+			// Newer stream we don't know about.
+			continue;
+		}
+
+		auto part = ttModel->MeshGroups[meshId]->Parts[partId];
+		if (stream != eStreamIndices && part->Vertices.Size() < count) {
+			part->Vertices.Resize(count);
+		}
+
+		if (!UnpackStream(stream, data, bytes, count, part->Vertices, part->Indices)) {
+			sqlite3_finalize(query);
+			error = "Invalid " + name + " stream data.";
+			return 202;
+		}
+	}
+	sqlite3_finalize(query);
+	return rc < 0 ? 201 : 0;
+}
+
+// Reads the shapes of every part from the shape_vertices table.
+int DBConverter::ReadShapes(sqlite3* conn, std::string& error) {
+	int rc;
+	sqlite3_stmt* query = MakeSqlStatement(conn, "select mesh, part, shape, vertex_id, position_x, position_y, position_z from shape_vertices order by mesh, part, shape, vertex_id");
+	while ((rc = NextRow(conn, query, error)) > 0) {
+		int meshId = sqlite3_column_int(query, 0);
+		int partId = sqlite3_column_int(query, 1);
+		std::string name = std::string(reinterpret_cast<const char*>(sqlite3_column_text(query, 2)));
+		int vertexId = sqlite3_column_int(query, 3);
+
+		auto part = ttModel->MeshGroups[meshId]->Parts[partId];
+		if (part->Shapes.count(name) == 0) {
+			auto shp = new TTShapePart();
+			shp->Name = name;
+			part->Shapes.insert({ name, shp });
 		}
+
+		auto shape = part->Shapes[name];
+
+		// Assign new position data.  Only the position changes; the rest comes from the base vertex on export.
+		FbxVector4 position;
+		position[0] = sqlite3_column_double(query, 4);
+		position[1] = sqlite3_column_double(query, 5);
+		position[2] = sqlite3_column_double(query, 6);
+
+		shape->VertexReplacements.emplace(vertexId, position);
 	}
+	sqlite3_finalize(query);
+	return rc < 0 ? 201 : 0;
 }
 
 // Reads the raw SQLite DB file and populates a TTModel object from it.
@@ -132,13 +422,15 @@ void DBConverter::ReadDB() {
 
 	ttModel = new TTModel();
 
-	std::vector<TTBone*> bones;
+	std::vector<TTBone*>& bones = ttModel->Bones;
+	int schemaVersion = 1;
 
 	// Meta Values
 	sqlite3_stmt* query = MakeSqlStatement("select key, value name from meta");
 	while (GetRow(query)) {
 		std::string key = std::string(reinterpret_cast<const char*>(sqlite3_column_text(query, 0)));
-		std::string value = std::string(reinterpret_cast<const char*>(sqlite3_column_text(query, 1)));
+		const char* text = reinterpret_cast<const char*>(sqlite3_column_text(query, 1));
+		std::string value = text != NULL ? text : "";
 		
 		if (value == "") {
 			continue;
@@ -170,7 +462,16 @@ void DBConverter::ReadDB() {
 			ttModel->Application = value;
 		}
 		else if (key == "for_3ds_max") {
-			_UseColor2Channel = value == "1" ? false : true;
+			useColor2Channel = value == "1" ? false : true;
+		}
+		else if (key == "schema_version") {
+			char* end = NULL;
+			long version = std::strtol(value.c_str(), &end, 10);
+			if (value.empty() || *end != '\0' || version < 1 || version > INT_MAX) {
+				sqlite3_finalize(query);
+				throw TTError(202, "Invalid schema_version in meta table: " + value);
+			}
+			schemaVersion = (int)version;
 		}
 	}
 	sqlite3_finalize(query);
@@ -215,14 +516,10 @@ void DBConverter::ReadDB() {
 		}
 
 		// Create mesh groups as needed.
-		while (meshId >= ttModel->MeshGroups.size()) {
-			ttModel->MeshGroups.push_back(new TTMeshGroup());
-			ttModel->MeshGroups[ttModel->MeshGroups.size() - 1]->Model = ttModel;
-			ttModel->MeshGroups[ttModel->MeshGroups.size() - 1]->MeshId = ttModel->MeshGroups.size() - 1;
-		}
-		ttModel->MeshGroups[meshId]->MaterialId = materialId;
-		ttModel->MeshGroups[meshId]->ModelNameId = modelId;
-		ttModel->MeshGroups[meshId]->Name = name;
+		TTMeshGroup* group = ttModel->GetMeshGroup(meshId);
+		group->MaterialId = materialId;
+		group->ModelNameId = modelId;
+		group->Name = name;
 	}
 	sqlite3_finalize(query);
 
@@ -238,22 +535,8 @@ void DBConverter::ReadDB() {
 			name = std::string(s);
 		}
 
-		// Create mesh groups as needed.
-		while (meshId >= ttModel->MeshGroups.size()) {
-			ttModel->MeshGroups.push_back(new TTMeshGroup());
-			ttModel->MeshGroups[ttModel->MeshGroups.size() - 1]->Model = ttModel;
-			ttModel->MeshGroups[ttModel->MeshGroups.size() - 1]->MeshId = ttModel->MeshGroups.size() - 1;
-		}
-
-		// Create parts as needed.
-		while (partId >= ttModel->MeshGroups[meshId]->Parts.size()) {
-			ttModel->MeshGroups[meshId]->Parts.push_back(new TTPart());
-			TTPart* part = ttModel->MeshGroups[meshId]->Parts[ttModel->MeshGroups[meshId]->Parts.size() - 1];
-			part->MeshGroup = ttModel->MeshGroups[meshId];
-			part->PartId = ttModel->MeshGroups[meshId]->Parts.size() - 1;
-		}
-
-		ttModel->MeshGroups[meshId]->Parts[partId]->Name = name;
+		// Create mesh groups and parts as needed.
+		ttModel->GetPart(meshId, partId)->Name = name;
 	}
 	sqlite3_finalize(query);
 
@@ -304,14 +587,15 @@ void DBConverter::ReadDB() {
 	while (GetRow(query)) {
 		TTBone* bone = new TTBone();
 
-		bone->Name = std::string(reinterpret_cast<const char*>(sqlite3_column_text(query, 0)));
+		bone->Name = ttModel->Names.Intern(reinterpret_cast<const char*>(sqlite3_column_text(query, 0)));
 
+		// No parent (or a blank one) makes this the root.
 		auto s = (char*)sqlite3_column_text(query, 1);
-		if (s != NULL) {
-			 bone->ParentName = std::string(s);
+		if (s != NULL && s[0] != '\0') {
+			bone->ParentName = ttModel->Names.Intern(s);
 		}
 		else {
-			bone->ParentName = "";
+			bone->ParentName = -1;
 		}
 
 		Eigen::Transform<double, 3, Eigen::Affine> matrix;
@@ -351,157 +635,61 @@ void DBConverter::ReadDB() {
 		std::string name = std::string(reinterpret_cast<const char*>(sqlite3_column_text(query, 2)));
 
 		// Fill in missing mesh groups (This shouldn't really ever happen, but safety)
-		while (meshId >= ttModel->MeshGroups.size()) {
-			ttModel->MeshGroups.push_back(new TTMeshGroup());
-		}
+		TTMeshGroup* group = ttModel->GetMeshGroup(meshId);
 
 		// Fill in missing bones as needed in case we read them out of order.
-		while (boneId >= ttModel->MeshGroups[meshId]->Bones.size()) {
-			ttModel->MeshGroups[meshId]->Bones.push_back("");
+		while (boneId >= group->Bones.size()) {
+			group->Bones.push_back(-1);
 		}
 
-		ttModel->MeshGroups[meshId]->Bones[boneId] = name;
+		group->Bones[boneId] = ttModel->Names.Intern(name);
 	}
 	sqlite3_finalize(query);
 
 	BuildSkeleton(bones);
 
-	// Indices
-	query = MakeSqlStatement("select mesh, part, index_id, vertex_id from indices order by mesh asc, part asc, index_id asc");
-	while (GetRow(query)) {
-		int meshId = sqlite3_column_int(query, 0);
-		int partId = sqlite3_column_int(query, 1);
-		int indexId = sqlite3_column_int(query, 2);
-		int vertexId= sqlite3_column_int(query, 3);
-
-		ttModel->MeshGroups[meshId]->Parts[partId]->Indices.push_back(vertexId);
+	// Vertex data lives in either the indices/vertices tables or the streams table.
+	std::vector<int (DBConverter::*)(sqlite3*, std::string&)> readers;
+	if (schemaVersion >= _TT_Streams_Schema_Version) {
+		readers.push_back(&DBConverter::ReadStreams);
 	}
-	sqlite3_finalize(query);
-
-
-	query = MakeSqlStatement("select mesh, part, vertex_id, position_x, position_y, position_z, normal_x, normal_y, normal_z, color_r, color_g, color_b, color_a, color2_r, color2_g, color2_b, color2_a, uv_1_u, uv_1_v, uv_2_u, uv_2_v, bone_1_id, bone_1_weight, bone_2_id, bone_2_weight, bone_3_id, bone_3_weight, bone_4_id, bone_4_weight, bone_5_id, bone_5_weight, bone_6_id, bone_6_weight, bone_7_id, bone_7_weight, bone_8_id, bone_8_weight, binormal_x, binormal_y, binormal_z, tangent_x, tangent_y, tangent_z, uv_3_u, uv_3_v, flow_u, flow_v from vertices order by mesh asc, part asc, vertex_id asc");
-	while (GetRow(query)) {
-		int meshId = sqlite3_column_int(query, 0);
-		int partId = sqlite3_column_int(query, 1);
-		int vertexId = sqlite3_column_int(query, 2);
-
-		TTVertex v;
-		v.Position[0] = sqlite3_column_double(query, 3);
-		v.Position[1] = sqlite3_column_double(query, 4);
-		v.Position[2] = sqlite3_column_double(query, 5);
-
-		v.Normal[0] = sqlite3_column_double(query, 6);
-		v.Normal[1] = sqlite3_column_double(query, 7);
-		v.Normal[2] = sqlite3_column_double(query, 8);
-
-		v.VertexColor[0] = sqlite3_column_double(query, 9);
-		v.VertexColor[1] = sqlite3_column_double(query, 10);
-		v.VertexColor[2] = sqlite3_column_double(query, 11);
-		v.VertexColor[3] = sqlite3_column_double(query, 12);
-
-		v.VertexColor2[0] = sqlite3_column_double(query, 13);
-		v.VertexColor2[1] = sqlite3_column_double(query, 14);
-		v.VertexColor2[2] = sqlite3_column_double(query, 15);
-		v.VertexColor2[3] = sqlite3_column_double(query, 16);
-
-		v.UV1[0] = sqlite3_column_double(query, 17);
-		v.UV1[1] = sqlite3_column_double(query, 18);
-
-		v.UV2[0] = sqlite3_column_double(query, 19);
-		v.UV2[1] = sqlite3_column_double(query, 20);
-
-		v.WeightSet.Weights[0].BoneId = sqlite3_column_int(query, 21);
-		v.WeightSet.Weights[0].Weight = sqlite3_column_double(query, 22);
-
-		v.WeightSet.Weights[1].BoneId = sqlite3_column_int(query, 23);
-		v.WeightSet.Weights[1].Weight = sqlite3_column_double(query, 24);
-
-		v.WeightSet.Weights[2].BoneId = sqlite3_column_int(query, 25);
-		v.WeightSet.Weights[2].Weight = sqlite3_column_double(query, 26);
-
-		v.WeightSet.Weights[3].BoneId = sqlite3_column_int(query, 27);
-		v.WeightSet.Weights[3].Weight = sqlite3_column_double(query, 28);
-
-		v.WeightSet.Weights[4].BoneId = sqlite3_column_int(query, 29);
-		v.WeightSet.Weights[4].Weight = sqlite3_column_double(query, 30);
-
-		v.WeightSet.Weights[5].BoneId = sqlite3_column_int(query, 31);
-		v.WeightSet.Weights[5].Weight = sqlite3_column_double(query, 32);
-
-		v.WeightSet.Weights[6].BoneId = sqlite3_column_int(query, 33);
-		v.WeightSet.Weights[6].Weight = sqlite3_column_double(query, 34);
-
-		v.WeightSet.Weights[7].BoneId = sqlite3_column_int(query, 35);
-		v.WeightSet.Weights[7].Weight = sqlite3_column_double(query, 36);
-
-		v.Binormal[0] = sqlite3_column_double(query, 37);
-		v.Binormal[1] = sqlite3_column_double(query, 38);
-		v.Binormal[2] = sqlite3_column_double(query, 39);
-
-		v.Tangent[0] = sqlite3_column_double(query, 40);
-		v.Tangent[1] = sqlite3_column_double(query, 41);
-		v.Tangent[2] = sqlite3_column_double(query, 42);
-
-		v.UV3[0] = sqlite3_column_double(query, 43);
-		v.UV3[1] = sqlite3_column_double(query, 44);
-
-		v.VertexColor3[0] = (sqlite3_column_double(query, 45) + 1) / 2.0f;
-		v.VertexColor3[1] = (sqlite3_column_double(query, 46) + 1) / 2.0f;
-		v.VertexColor3[2] = 1;
-		v.VertexColor3[3] = 1;
-
-
-		ttModel->MeshGroups[meshId]->Parts[partId]->Vertices.push_back(v);
+	else {
+		readers.push_back(&DBConverter::ReadIndices);
+		readers.push_back(&DBConverter::ReadVertices);
 	}
-	sqlite3_finalize(query);
-
-	query = MakeSqlStatement("select mesh, part, shape, vertex_id, position_x, position_y, position_z from shape_vertices order by mesh, part, shape, vertex_id");
-	while (GetRow(query)) {
-		int meshId = sqlite3_column_int(query, 0);
-		int partId = sqlite3_column_int(query, 1);
-		std::string name = std::string(reinterpret_cast<const char*>(sqlite3_column_text(query, 2)));
-		int vertexId = sqlite3_column_int(query, 3);
-
-		auto part = ttModel->MeshGroups[meshId]->Parts[partId];
-		if (part->Shapes.count(name) == 0) {
-			auto shp = new TTShapePart();
-			shp->Name = name;
-			part->Shapes.insert({ name, shp });
-		}
-
-		auto shape = part->Shapes[name];
-
-		// Assign new position data.
-		TTVertex v;
-		v.Position[0] = sqlite3_column_double(query, 4);
-		v.Position[1] = sqlite3_column_double(query, 5);
-		v.Position[2] = sqlite3_column_double(query, 6);
-
-		auto rep = part->Vertices[vertexId];
-
-		// Copy over other values for convenience.
-		v.Normal = rep.Normal;
-		v.Binormal = rep.Binormal;
-		v.Tangent = rep.Tangent;
-		v.VertexColor = rep.VertexColor;
-		v.VertexColor2 = rep.VertexColor2;
-		v.VertexColor3 = rep.VertexColor3;
-		v.UV1 = rep.UV1;
-		v.UV2 = rep.UV2;
-		v.UV3 = rep.UV3;
-
-		for (int i = 0; i < _TTW_Max_Weights; i++) {
-			v.WeightSet.Weights[i] = rep.WeightSet.Weights[i];
-			if (i < 4) {
-				v.VertexColor[i] = rep.VertexColor[i];
-				v.VertexColor2[i] = rep.VertexColor2[i];
-				v.VertexColor3[i] = rep.VertexColor3[i];
+	readers.push_back(&DBConverter::ReadShapes);
+
+	// These don't depend on one another, and each fills in different parts of the TTParts
+	// created above, so read them side by side, each on its own connection.
+	std::vector<int> results(readers.size(), 0);
+	std::vector<std::string> errors(readers.size());
+	std::vector<std::thread> threads;
+	for (unsigned int i = 0; i < readers.size(); i++) {
+		threads.emplace_back([this, &readers, &results, &errors, i]() {
+			// Anything thrown here would end the process, so it's passed back like any other failure.
+			try {
+				results[i] = RunReader(readers[i], errors[i]);
 			}
-		}
-
-		shape->VertexReplacements.insert({vertexId, v});
+			catch (std::exception& e) {
+				results[i] = _TT_Unhandled_Error;
+				errors[i] = e.what();
+			}
+			catch (...) {
+				results[i] = _TT_Unhandled_Error;
+				errors[i] = "Unknown error.";
+			}
+		});
+	}
+	for (unsigned int i = 0; i < threads.size(); i++) {
+		threads[i].join();
 	}
 
+	for (unsigned int i = 0; i < results.size(); i++) {
+		if (results[i] != 0) {
+			fprintf(stderr, "SQLite Error: %s", errors[i].c_str());
+			throw TTError(results[i], "Unable to read DB file.");
+		}
+	}
 
 	int z = 0;
 	z++;
@@ -702,7 +890,7 @@ void DBConverter::AddBoneToScene(TTBone* bone, FbxPose* bindPose) {
 		parentNode = bone->Parent->Node;
 	}
 
-	FbxNode* node = FbxNode::Create(manager, bone->Name.c_str());
+	FbxNode* node = FbxNode::Create(manager, ttModel->Names.Get(bone->Name).c_str());
 	bone->Node = node;
 
 	FbxSkeleton* skeletonAttribute = FbxSkeleton::Create(scene, "Skeleton");
@@ -742,7 +930,15 @@ void DBConverter::AddBoneToScene(TTBone* bone, FbxPose* bindPose) {
 	}
 }
 
-FbxMesh* DBConverter::MakeMesh(std::vector<TTVertex> vertices, std::vector<int> indices, std::string meshName, FbxNode* parent, FbxSurfaceMaterial* material) {
+// Sizes a layer element's direct array and returns its storage for writing.
+// The caller releases it with GetDirectArray().Release() once done.
+template <typename T>
+static T* LockForWrite(FbxLayerElementTemplate<T>* layerElement, int count) {
+	layerElement->GetDirectArray().Resize(count);
+	return layerElement->GetDirectArray().GetLocked(FbxLayerElementArray::eWriteLock);
+}
+
+FbxMesh* DBConverter::MakeMesh(const TTVertexBuffer& vertices, const std::vector<int>& indices, const std::string& meshName, FbxNode* parent, FbxSurfaceMaterial* material) {
 	
 	FbxMesh* mesh = FbxMesh::Create(manager, meshName.c_str());
 	// set the shading mode to view texture
@@ -754,10 +950,10 @@ FbxMesh* DBConverter::MakeMesh(std::vector<TTVertex> vertices, std::vector<int>
 	lMaterialElement->SetMappingMode(FbxGeometryElement::eAllSame);
 
 
-	mesh->InitControlPoints(vertices.size());
-	mesh->InitNormals(vertices.size());
-	mesh->InitBinormals(vertices.size());
-	mesh->InitTangents(vertices.size());
+	mesh->InitControlPoints(vertices.Size());
+	mesh->InitNormals(vertices.Size());
+	mesh->InitBinormals(vertices.Size());
+	mesh->InitTangents(vertices.Size());
 
 	//binEl[0] 
 
@@ -797,7 +993,7 @@ FbxMesh* DBConverter::MakeMesh(std::vector<TTVertex> vertices, std::vector<int>
 	FbxLayerElementVertexColor* color3Layer = 0;
 	FbxLayerElementUV* color2Layer_rg = 0;
 	FbxLayerElementUV* color2Layer_ba = 0;
-	if (_UseColor2Channel) {
+	if (useColor2Channel) {
 		color2Layer = FbxLayerElementVertexColor::Create(mesh, "vc1");
 		color2Layer->SetMappingMode(FbxLayerElement::EMappingMode::eByControlPoint);
 		layer1->SetVertexColors(color2Layer);
@@ -815,55 +1011,77 @@ FbxMesh* DBConverter::MakeMesh(std::vector<TTVertex> vertices, std::vector<int>
 	tangentLayer->SetMappingMode(FbxLayerElement::EMappingMode::eByControlPoint);
 	layer0->SetTangents(tangentLayer);
 
-	for (int i = 0; i < vertices.size(); i++) {
-		TTVertex v = vertices[i];
-
-		mesh->SetControlPointAt(v.Position, v.Normal, i);
-		binormalLayer->GetDirectArray().Add(v.Binormal);
-		tangentLayer->GetDirectArray().Add(v.Tangent);
-		colorLayer->GetDirectArray().Add(v.VertexColor);
-		uvLayer->GetDirectArray().Add(FbxVector2(v.UV1[0], v.UV1[1]));
-		uv2Layer->GetDirectArray().Add(FbxVector2(v.UV2[0], v.UV2[1]));
-		uv3Layer->GetDirectArray().Add(FbxVector2(v.UV3[0], v.UV3[1]));
-
-		if (_UseColor2Channel) {
-			color2Layer->GetDirectArray().Add(v.VertexColor2);
-			color3Layer->GetDirectArray().Add(v.VertexColor3);
+	// Size every array once, then write them straight through.
+	int vertexCount = vertices.Size();
+	FbxVector4* controlPoints = mesh->GetControlPoints();
+	FbxLayerElementNormal* normalLayer = layer0->GetNormals();
+	FbxVector4* normals = LockForWrite(normalLayer, vertexCount);
+	FbxVector4* binormals = LockForWrite(binormalLayer, vertexCount);
+	FbxVector4* tangents = LockForWrite(tangentLayer, vertexCount);
+	FbxColor* colors = LockForWrite(colorLayer, vertexCount);
+	FbxVector2* uvs = LockForWrite(uvLayer, vertexCount);
+	FbxVector2* uvs2 = LockForWrite(uv2Layer, vertexCount);
+	FbxVector2* uvs3 = LockForWrite(uv3Layer, vertexCount);
+	FbxColor* colors2 = useColor2Channel ? LockForWrite(color2Layer, vertexCount) : NULL;
+	FbxColor* colors3 = useColor2Channel ? LockForWrite(color3Layer, vertexCount) : NULL;
+
+	for (int i = 0; i < vertexCount; i++) {
+		controlPoints[i] = vertices.GetPosition(i);
+		normals[i] = vertices.GetNormal(i);
+		binormals[i] = vertices.GetBinormal(i);
+		tangents[i] = vertices.GetTangent(i);
+		colors[i] = vertices.GetColor(0, i);
+		uvs[i] = vertices.GetUV(0, i);
+		uvs2[i] = vertices.GetUV(1, i);
+		uvs3[i] = vertices.GetUV(2, i);
+
+		if (useColor2Channel) {
+			colors2[i] = vertices.GetColor(1, i);
+			colors3[i] = vertices.GetFlowColor(i);
 		}
 	}
 
+	normalLayer->GetDirectArray().Release(&normals);
+	binormalLayer->GetDirectArray().Release(&binormals);
+	tangentLayer->GetDirectArray().Release(&tangents);
+	colorLayer->GetDirectArray().Release(&colors);
+	uvLayer->GetDirectArray().Release(&uvs);
+	uv2Layer->GetDirectArray().Release(&uvs2);
+	uv3Layer->GetDirectArray().Release(&uvs3);
+	if (useColor2Channel) {
+		color2Layer->GetDirectArray().Release(&colors2);
+		color3Layer->GetDirectArray().Release(&colors3);
+	}
+
+	// The SDK has no bulk polygon setter, but reserving up front keeps it from growing the polygon arrays as we go.
+	mesh->ReservePolygonCount(indices.size() / 3);
+	mesh->ReservePolygonVertexCount(indices.size());
 	for (int i = 0; i < indices.size(); i += 3) {
 		mesh->BeginPolygon();
 		mesh->AddPolygon(indices[i]);
 		mesh->AddPolygon(indices[i + 1]);
 		mesh->AddPolygon(indices[i + 2]);
 		mesh->EndPolygon();
-
-		TTVertex vert1 = vertices[indices[i]];
-		TTVertex vert2 = vertices[indices[i + 1]];
-		TTVertex vert3 = vertices[indices[i + 2]];
-
-
 	}
 
 	return mesh;
 }
 
-FbxShape* DBConverter::MakeShape(std::vector<TTVertex> vertices, std::string meshName) {
+// Builds a shape from the base mesh's control points and normals, plus the shape's moved positions.
+FbxShape* DBConverter::MakeShape(FbxMesh* baseMesh, const TTShapePart* shape, const std::string& meshName) {
 	FbxShape* shapeMesh = FbxShape::Create(manager, meshName.c_str());
 
-	shapeMesh->InitControlPoints(vertices.size());
-	shapeMesh->InitNormals(vertices.size());
-
-	shapeMesh->InitControlPoints(vertices.size());
-	shapeMesh->InitNormals(vertices.size());
+	int count = baseMesh->GetControlPointsCount();
+	shapeMesh->InitControlPoints(count);
+	shapeMesh->InitNormals(baseMesh);
 
 	FbxVector4* cps = shapeMesh->GetControlPoints();
+	memcpy(cps, baseMesh->GetControlPoints(), count * sizeof(FbxVector4));
 
-	for (int i = 0; i < vertices.size(); i++) {
-		TTVertex v = vertices[i];
-
-		shapeMesh->SetControlPointAt(v.Position, v.Normal, i);
+	for (auto it = shape->VertexReplacements.begin(); it != shape->VertexReplacements.end(); ++it) {
+		if (it->first >= 0 && it->first < count) {
+			cps[it->first] = it->second;
+		}
 	}
 
 	return shapeMesh;
@@ -897,21 +1115,7 @@ void DBConverter::AddPartToScene(TTPart* part, FbxNode* parent) {
 			auto shape = it->second;
 			auto channel = FbxBlendShapeChannel::Create(blendShape, std::string("channel_" + shape->Name).c_str());
 
-			// Need to make our modified vertex array here.
-			std::vector<TTVertex> shapeVertices;
-
-			for (int i = 0; i < part->Vertices.size(); i++) {
-				auto it = shape->VertexReplacements.find(i);
-				if (it != shape->VertexReplacements.end()) {
-					auto vert = it->second;
-					shapeVertices.push_back(vert);
-				}
-				else {
-					shapeVertices.push_back(part->Vertices[i]);
-				}
-			}
-
-			auto shapeMesh = MakeShape(shapeVertices, shape->Name);
+			auto shapeMesh = MakeShape(mesh, shape, shape->Name);
 			channel->SetMultiLayer(false);
 			channel->AddTargetShape(shapeMesh);
 		}
@@ -929,11 +1133,42 @@ void DBConverter::AddPartToScene(TTPart* part, FbxNode* parent) {
 
 	mesh->AddDeformer(skin);
 
-	// For every possible bone
-	for (int bi = 0; bi < part->MeshGroup->Bones.size(); bi++) {
-		auto boneName = part->MeshGroup->Bones[bi];
-		TTBone* bone = ttModel->GetBone(boneName);
+	// Bucket the weights by bone in one pass over the vertices.
+	// The weights of bone bi are boneWeightIndices/boneWeights[boneStart[bi]] up to [boneStart[bi + 1]].
+	// Empty slots hold _TTW_No_Bone, which is never a valid bone index.
+	int boneCount = part->MeshGroup->Bones.size();
+	int slotCount = part->Vertices.Size() * _TTW_Max_Weights;
+	const uint16_t* boneIds = part->Vertices.BoneIds.data();
+	const uint16_t* weights = part->Vertices.Weights.data();
+	std::vector<int> boneStart(boneCount + 1, 0);
+	for (int w = 0; w < slotCount; w++) {
+		if (boneIds[w] < boneCount && weights[w] > 0) {
+			boneStart[boneIds[w] + 1]++;
+		}
+	}
+	for (int bi = 0; bi < boneCount; bi++) {
+		boneStart[bi + 1] += boneStart[bi];
+	}
+
+	std::vector<int> boneWeightIndices(boneStart[boneCount]);
+	std::vector<double> boneWeights(boneStart[boneCount]);
+	std::vector<int> boneFill(boneStart.begin(), boneStart.end() - 1);
+	for (int w = 0; w < slotCount; w++) {
+		if (boneIds[w] < boneCount && weights[w] > 0) {
+			int slot = boneFill[boneIds[w]]++;
+			boneWeightIndices[slot] = w / _TTW_Max_Weights;
+			boneWeights[slot] = weights[w] / 65535.0;
+		}
+	}
+
+	// For every bone with any weights
+	for (int bi = 0; bi < boneCount; bi++) {
+		int weightCount = boneStart[bi + 1] - boneStart[bi];
+		if (weightCount == 0) continue;
+
+		TTBone* bone = ttModel->GetBone(part->MeshGroup->Bones[bi]);
 		if (bone == NULL) continue;
+		const std::string& boneName = ttModel->Names.Get(bone->Name);
 
 		// Create a cluster for it.
 		FbxCluster* cluster = FbxCluster::Create(scene, std::string(partName + " " + boneName + " Cluster").c_str());
@@ -946,34 +1181,14 @@ void DBConverter::AddPartToScene(TTPart* part, FbxNode* parent) {
 		cluster->SetTransformMatrix(node->EvaluateGlobalTransform());
 		cluster->SetTransformLinkMatrix(bone->Node->EvaluateGlobalTransform());
 
+		// Copy the bone's weights in, in vertex order.
+		cluster->SetControlPointIWCount(weightCount);
+		memcpy(cluster->GetControlPointIndices(), &boneWeightIndices[boneStart[bi]], weightCount * sizeof(int));
+		memcpy(cluster->GetControlPointWeights(), &boneWeights[boneStart[bi]], weightCount * sizeof(double));
 
-		// For every Vertex.
-		for (int vi = 0; vi < mesh->GetControlPointsCount(); vi++) {
-			auto v = part->Vertices[vi];
-
-			// For every weight set.
-			for (int wi = 0; wi < _TTW_Max_Weights; wi++) {
-				auto set = v.WeightSet.Weights[wi];
-
-				// If we're the same bone and we have weight.
-				if (set.BoneId == bi && set.Weight > 0) {
-
-					// Add the weight to this bone's weight list.
-					cluster->AddControlPointIndex(vi, set.Weight);
-				}
-			}
-		}
-
-		// Add the cluster if we have any weights.
-		if (cluster->GetControlPointIndicesCount() > 0) {
-			skin->AddCluster(cluster);
-			assert(cluster->GetLink() == bone->Node);
-			assert(cluster->GetSubDeformerType() == FbxSubDeformer::eCluster);
-			
-		}
-		else {
-			cluster->Destroy();
-		}
+		skin->AddCluster(cluster);
+		assert(cluster->GetLink() == bone->Node);
+		assert(cluster->GetSubDeformerType() == FbxSubDeformer::eCluster);
 	}
 
 
@@ -1012,18 +1227,33 @@ void DBConverter::ExportScene() {
 	FbxExporter* exporter = FbxExporter::Create(manager, "");
 	//exporter->SetFileExportVersion(FBX_2010_00_COMPATIBLE);
 
-	// File is always piped to this directory currently.
-	const char* lFilename = "result.fbx";
+	// Goes to the working directory unless we were told otherwise.
+	std::string filename = options.Output.empty() ? "result.fbx" : utf8_encode(options.Output);
+	const char* lFilename = filename.c_str();
 
 	ios->SetBoolProp(EXP_FBX_ANIMATION, true);
 
-	// Initialize the exporter.
+	// Initialize the exporter, into memory if that's where the file is wanted.
 	manager->SetIOSettings(ios);
-	bool exportStatus = exporter->Initialize(lFilename, -1, ios);
+	int writerId = manager->GetIOPluginRegistry()->GetNativeWriterFormat();
+	TTMemoryStream stream(writerId);
+
+	bool exportStatus;
+	if (outputBuffer != NULL) {
+		exportStatus = exporter->Initialize(&stream, NULL, writerId, ios);
+	}
+	else {
+		// Start from a fresh file.  The old one may be hardlinked to a cached result,
+		// which must not be written through.
+		std::error_code ec;
+		std::filesystem::remove(options.Output.empty() ? std::filesystem::path(L"result.fbx") : std::filesystem::path(options.Output), ec);
+		exportStatus = exporter->Initialize(lFilename, -1, ios);
+	}
 	if (!exportStatus) {
 		printf("Call to FbxExporter::Initialize() failed.\n");
 		printf("Error returned: %s\n\n", exporter->GetStatus().GetErrorString());
-		Shutdown(800);
+		exporter->Destroy();
+		throw TTError(800);
 	}
 
 
@@ -1031,24 +1261,114 @@ void DBConverter::ExportScene() {
 
 	// Destroy the exporter.
 	exporter->Destroy();
+
+	if (outputBuffer != NULL) {
+		outputBuffer->swap(stream.Buffer);
+	}
 }
 
-int DBConverter::ConvertDB(std::wstring dbFile) {
-	int ret = Init(dbFile);
+/**
+ * Converts the given DB file to result.fbx, or the output path in the options.
+ * If a manager is supplied, it's used as is and left alive afterwards.
+ * Returns 0 on success, or the error code.
+ */
+int DBConverter::ConvertDB(std::wstring dbFile, TTOptions exportOptions, FbxManager* sharedManager) {
+	options = exportOptions;
+	int ret = Init(dbFile, sharedManager);
 	if (ret != 0) {
 		return ret;
 	}
-	
-	// Load data from the DB file itself.
-	ReadDB();
 
-	// Create the FBX Scene.
-	CreateScene();
+	try {
+		// Load data from the DB file itself.
+		ReadDB();
 
-	// Export the FBX Scene.
-	ExportScene();
-	
-	Shutdown(0);
-	return 0;
+		// Create the FBX Scene.
+		CreateScene();
+
+		// Export the FBX Scene.
+		ExportScene();
+	}
+	catch (TTError& e) {
+		return Shutdown(e.Code, e.what());
+	}
+	catch (std::exception& e) {
+		return Shutdown(_TT_Unhandled_Error, e.what());
+	}
+	catch (...) {
+		return Shutdown(_TT_Unhandled_Error, "Unknown error.");
+	}
+
+	return Shutdown(0);
+}
+
+bool DBConverter::ReadTexturePaths(const std::wstring& dbFile, std::vector<std::string>& paths) {
+	sqlite3* conn;
+	if (OpenReadOnly(utf8_encode(dbFile), &conn) != SQLITE_OK) {
+		sqlite3_close(conn);
+		return false;
+	}
+
+	sqlite3_stmt* query = NULL;
+	int rc = sqlite3_prepare_v2(conn, "select diffuse, normal, specular, opacity, emissive from materials order by material_id asc", -1, &query, NULL);
+	while (rc == SQLITE_OK && (rc = sqlite3_step(query)) == SQLITE_ROW) {
+		for (int c = 0; c < 5; c++) {
+			const char* path = (const char*)sqlite3_column_text(query, c);
+			if (path != NULL && path[0] != '\0') {
+				paths.push_back(path);
+			}
+		}
+		rc = SQLITE_OK;
+	}
+	sqlite3_finalize(query);
+	sqlite3_close(conn);
+	return rc == SQLITE_DONE;
+}
+
+/**
+ * Converts an already populated model to FBX, without going through a DB.
+ * The model still belongs to the caller afterwards.  If a buffer is supplied, the FBX file
+ * is written into it, rather than to result.fbx or the output path in the options.
+ * Returns 0 on success, or the error code.
+ */
+int DBConverter::ConvertModel(TTModel* model, std::vector<char>* buffer, TTOptions exportOptions, FbxManager* sharedManager) {
+	options = exportOptions;
+	ttModel = model;
+	ownsModel = false;
+	outputBuffer = buffer;
+
+	InitManager(sharedManager);
+
+	try {
+		// A model that wasn't read from a DB may not have its skeleton assembled yet.
+		if (ttModel->FullSkeleton == NULL) {
+			BuildSkeleton(ttModel->Bones);
+		}
+		// Every mesh group needs a model name and material to hang off.
+		for (unsigned int i = 0; i < ttModel->MeshGroups.size(); i++) {
+			TTMeshGroup* group = ttModel->MeshGroups[i];
+			while (group->ModelNameId >= (int)ttModel->ModelNames.size()) {
+				ttModel->ModelNames.push_back(ttModel->RootName);
+			}
+			while (group->MaterialId >= (int)ttModel->Materials.size()) {
+				TTMaterial* material = new TTMaterial();
+				material->Name = "Material " + std::to_string(ttModel->Materials.size());
+				ttModel->Materials.push_back(material);
+			}
+		}
+
+		CreateScene();
+		ExportScene();
+	}
+	catch (TTError& e) {
+		return Shutdown(e.Code, e.what());
+	}
+	catch (std::exception& e) {
+		return Shutdown(_TT_Unhandled_Error, e.what());
+	}
+	catch (...) {
+		return Shutdown(_TT_Unhandled_Error, "Unknown error.");
+	}
 
+	return Shutdown(0);
 }
@@ -18,42 +18,79 @@
 #include <exception>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <regex>
+#include <thread>
+#include <cstdlib>
+#include <climits>
+#include <filesystem>
 #include "tchar.h"
 
 
 // Custom
 #include <tt_model.h>
+#include <tt_streams.h>
+#include <tt_error.h>
+#include <tt_options.h>
+#include <fbx_memory_stream.h>
+#include <tt_utf8.h>
 
 
 class DBConverter {
-	sqlite3* db;
-	FbxManager* manager;
-	FbxScene* scene;
+	sqlite3* db = NULL;
+	FbxManager* manager = NULL;
+	FbxScene* scene = NULL;
 
-	TTModel* ttModel;
+	// False when the manager was handed to us, and outlives this conversion.
+	bool ownsManager = true;
+
+	TTModel* ttModel = NULL;
+
+	// False when the model was handed to us, and belongs to the caller.
+	bool ownsModel = true;
+
+	TTOptions options;
+
+	// Set to export the FBX file into memory, instead of writing it out.
+	std::vector<char>* outputBuffer = NULL;
+
+	// Export the second and third vertex color channels.  Turned off for 3DS Max, per the DB's meta table.
+	bool useColor2Channel = true;
 
 	void CreateMaterials();
 
-	void Shutdown(int code, const char* errorMessage = NULL);
+	int Shutdown(int code, const char* errorMessage = NULL);
 	void WriteLog(std::string message, bool warning = false);
 	
 	void ReadDB();
+	int RunReader(int (DBConverter::*reader)(sqlite3* conn, std::string& error), std::string& error);
+	int ReadIndices(sqlite3* conn, std::string& error);
+	int ReadVertices(sqlite3* conn, std::string& error);
+	int ReadStreams(sqlite3* conn, std::string& error);
+	int ReadShapes(sqlite3* conn, std::string& error);
 	void CreateScene();
 	void ExportScene();
 
-	FbxMesh* MakeMesh(std::vector<TTVertex> vertices, std::vector<int> indices, std::string meshName, FbxNode* parent, FbxSurfaceMaterial* material);
-	void RepopulateMesh(FbxMesh* mesh, std::vector<TTVertex> vertices, std::vector<int> indices, std::string meshName, FbxNode* parent, FbxSurfaceMaterial* material);
-	FbxShape* MakeShape(std::vector<TTVertex> vertices, std::string meshName);
+	FbxMesh* MakeMesh(const TTVertexBuffer& vertices, const std::vector<int>& indices, const std::string& meshName, FbxNode* parent, FbxSurfaceMaterial* material);
+	void RepopulateMesh(FbxMesh* mesh, const TTVertexBuffer& vertices, const std::vector<int>& indices, const std::string& meshName, FbxNode* parent, FbxSurfaceMaterial* material);
+	FbxShape* MakeShape(FbxMesh* baseMesh, const TTShapePart* shape, const std::string& meshName);
 	void AddPartToScene(TTPart* part, FbxNode* parent);
-	void BuildSkeleton(std::vector<TTBone*> bones);
-	void AssignChildren(TTBone* root, std::vector<TTBone*> bones);
+	void BuildSkeleton(const std::vector<TTBone*>& bones);
+	void AssignChildren(TTBone* root, const std::vector<std::vector<TTBone*>>& children);
 	void AddBoneToScene(TTBone* bone, FbxPose* bindPose);
 
 	sqlite3_stmt* MakeSqlStatement(std::string query);
+	sqlite3_stmt* MakeSqlStatement(sqlite3* conn, std::string query);
 	bool GetRow(sqlite3_stmt* statement);
 
-	int Init(std::wstring dbFilePath);
+	int Init(std::wstring dbFilePath, FbxManager* sharedManager);
+	void InitManager(FbxManager* sharedManager);
 public:
-	int ConvertDB(std::wstring dbFile);
+	int ConvertDB(std::wstring dbFile, TTOptions exportOptions = TTOptions(), FbxManager* sharedManager = NULL);
+	int ConvertModel(TTModel* model, std::vector<char>* buffer = NULL, TTOptions exportOptions = TTOptions(), FbxManager* sharedManager = NULL);
+
+	// Gets the texture file paths the DB's materials reference, which get embedded in the FBX.
+	// Paths are UTF-8, as stored, and relative ones are relative to the working directory.
+	// Returns false if the DB couldn't be read.
+	static bool ReadTexturePaths(const std::wstring& dbFile, std::vector<std::string>& paths);
 };
\ No newline at end of file
@@ -3,56 +3,76 @@
 
 
 const char* initScript = "SQL/CreateDB.SQL";
-const char* dbPath = "result.db";
+
+// Where the DB goes unless the options say otherwise.
+const wchar_t* defaultDbPath = L"result.db";
+
+// Settings used while the DB is being written.  Nothing needs to survive a crash mid-import,
+// as the DB is rebuilt from scratch every time.  page_size only applies before the first table exists.
+const char* bulkLoadPragmas = "PRAGMA page_size = 65536; PRAGMA journal_mode = MEMORY; PRAGMA synchronous = OFF; PRAGMA cache_size = -65536;";
+
+// Settings restored once the import's transaction is committed.
+const char* durablePragmas = "PRAGMA journal_mode = DELETE; PRAGMA synchronous = FULL;";
+
 const std::regex meshRegex(".*[_ ^][0-9]+[\\.\\-]?([0-9]+)?$");
 const std::regex extractMeshInfoRegex(".*[_ ^]([0-9]+)[\\.\\-]?([0-9]+)?$");
 
+// Every column of the vertices table, in the order WriteRows binds them.
+const char* vertexColumns = "mesh, part, vertex_id, position_x, position_y, position_z, normal_x, normal_y, normal_z, color_r, color_g, color_b, color_a, color2_r, color2_g, color2_b, color2_a, uv_1_u, uv_1_v, uv_2_u, uv_2_v, bone_1_id, bone_1_weight, bone_2_id, bone_2_weight, bone_3_id, bone_3_weight, bone_4_id, bone_4_weight, bone_5_id, bone_5_weight, bone_6_id, bone_6_weight, bone_7_id, bone_7_weight, bone_8_id, bone_8_weight, binormal_x, binormal_y, binormal_z, tangent_x, tangent_y, tangent_z, uv_3_u, uv_3_v, flow_u, flow_v";
+
 // Below this value the weight will be rounded down to 0 anyways in FFXIV.
 float _MINIMUM_WEIGHT_VALUE = ( 1.0f / 255.0f ) * 0.5f;
 
-std::string utf8_encode(const std::wstring& wstr)
-{
-	if (wstr.empty()) return std::string();
-	int size_needed = WideCharToMultiByte(CP_UTF8, 0, &wstr[0], (int)wstr.size(), NULL, 0, NULL, NULL);
-	std::string strTo(size_needed, 0);
-	WideCharToMultiByte(CP_UTF8, 0, &wstr[0], (int)wstr.size(), &strTo[0], size_needed, NULL, NULL);
-	return strTo;
-}
-
-inline bool FBXImporter::file_exists(const std::string& name) {
-
-	std::fstream fs;
-	fs.open(name, std::fstream::in);
-	if (fs.fail()) {
-		return false;
-	}
-	fs.close();
-	return true;
+// The DB schema script.  Read the first time it's needed and kept for later imports.
+static const std::string& GetSchemaSql() {
+	static const std::string sql = []() {
+		std::ifstream file(initScript);
+		std::string str;
+		std::string fullSql = "";
+		while (std::getline(file, str))
+		{
+			fullSql += str + "\n";
+		}
+		file.close();
+		return fullSql;
+	}();
+	return sql;
 }
 
 
 /**
- * Attempts to initialize the SQLite Database and FBX scene.
+ * Creates the SQLite Database and its schema, ready for the import to write to.
  * Returns 0 on success, non-zero on error.
  */
-int FBXImporter::Init(std::wstring fbxFilePath, sqlite3** database, FbxManager** manager, FbxScene** scene) {
+int FBXImporter::InitDB(sqlite3** database) {
 
 	char* zErrMsg = 0;
 	int rc;
-	auto utf = utf8_encode(fbxFilePath);
-	fprintf(stdout, "Attempting to process FBX: %ls\n", fbxFilePath.c_str());
 
-	if (file_exists(dbPath)) {
-		int failure = remove(dbPath);
-		if (failure != 0) {
+	std::error_code ec;
+	prevDbPath.clear();
+	prevFingerprints.clear();
+	if (std::filesystem::exists(dbPath, ec)) {
+		if (options.Incremental) {
+			// Keep the last result around to copy unchanged parts from.
+			prevDbPath = dbPath + L".prev";
+			std::filesystem::remove(prevDbPath, ec);
+			std::filesystem::rename(dbPath, prevDbPath, ec);
+			if (ec) {
+				fprintf(stderr, "Unable to move existing database aside.\n");
+				prevDbPath.clear();
+				return 102;
+			}
+		}
+		else if (!std::filesystem::remove(dbPath, ec)) {
 			fprintf(stderr, "Unable to remove existing database.\n");
 			return 102;
 		}
 
 	}
 
-	// Create and connect to the database file.
-	rc = sqlite3_open(dbPath, database);
+	// Create and connect to the database file, or an in-memory DB that Shutdown writes out.
+	rc = sqlite3_open(options.MemoryDb ? ":memory:" : utf8_encode(dbPath).c_str(), database);
 	if (rc) {
 		fprintf(stderr, "Failed to create database: %s\n", sqlite3_errmsg(*database));
 		sqlite3_close(*database);
@@ -60,18 +80,25 @@ int FBXImporter::Init(std::wstring fbxFilePath, sqlite3** database, FbxManager**
 	}
 
 
-	// Read the DB Creation file.
-	std::ifstream file(initScript);
-	std::string str;
-	std::string fullSql = "";
-	while (std::getline(file, str))
-	{
-		fullSql += str + "\n";
+	// Switch to bulk-load settings and run the whole import, schema included, in one transaction.
+	rc = sqlite3_exec(*database, bulkLoadPragmas, NULL, 0, &zErrMsg);
+
+	// Databases can't be attached inside a transaction.
+	if (rc == SQLITE_OK && !prevDbPath.empty()) {
+		AttachPreviousDB(*database);
+	}
+	if (rc == SQLITE_OK) {
+		rc = sqlite3_exec(*database, "BEGIN TRANSACTION;", NULL, 0, &zErrMsg);
+	}
+	if (rc != SQLITE_OK) {
+		fprintf(stderr, "Database setup SQL error: %s", zErrMsg);
+		sqlite3_free(zErrMsg);
+		sqlite3_close(*database);
+		return 104;
 	}
-	file.close();
 
 	// Create the DB Schema.
-	rc = sqlite3_exec(*database, fullSql.c_str(), NULL, 0, &zErrMsg);
+	rc = sqlite3_exec(*database, GetSchemaSql().c_str(), NULL, 0, &zErrMsg);
 	if (rc != SQLITE_OK) {
 		fprintf(stderr, "Database creation SQL error: %s", zErrMsg);
 		sqlite3_free(zErrMsg);
@@ -79,14 +106,99 @@ int FBXImporter::Init(std::wstring fbxFilePath, sqlite3** database, FbxManager**
 		return 104;
 	}
 
+	return 0;
+}
+
+/**
+ * Attaches the previous import's DB as "prev", and reads the fingerprints of its parts.
+ * If it can't be read, every part is simply extracted again.
+ */
+void FBXImporter::AttachPreviousDB(sqlite3* database) {
+	std::string path = utf8_encode(prevDbPath);
+	sqlite3_stmt* query = NULL;
+	int rc = sqlite3_prepare_v2(database, "ATTACH DATABASE ?1 AS prev", -1, &query, NULL);
+	if (rc == SQLITE_OK) {
+		sqlite3_bind_text(query, 1, path.c_str(), path.length(), NULL);
+		rc = sqlite3_step(query) == SQLITE_DONE ? SQLITE_OK : SQLITE_ERROR;
+	}
+	sqlite3_finalize(query);
+
+	query = NULL;
+	if (rc == SQLITE_OK) {
+		rc = sqlite3_prepare_v2(database, "select key, value from prev.meta where key glob 'fingerprint_*'", -1, &query, NULL);
+	}
+	while (rc == SQLITE_OK && sqlite3_step(query) == SQLITE_ROW) {
+		const char* key = (const char*)sqlite3_column_text(query, 0);
+		const char* value = (const char*)sqlite3_column_text(query, 1);
+		int mesh, part;
+		if (value != NULL && sscanf(key, "fingerprint_%d_%d", &mesh, &part) == 2) {
+			prevFingerprints[{ mesh, part }] = std::strtoull(value, NULL, 16);
+		}
+	}
+	sqlite3_finalize(query);
+
+	if (rc != SQLITE_OK) {
+		fprintf(stderr, "Warning: Unable to read the previous database, every mesh will be imported again: %s\n", sqlite3_errmsg(database));
+		prevFingerprints.clear();
+	}
+	else {
+		fprintf(stdout, "Incremental import against %d previously imported parts.\n", (int)prevFingerprints.size());
+	}
+}
+
+// Done with the previous import's DB, once the new one is closed.  It's deleted if the
+// import succeeded, and otherwise put back in place of the partial new DB.
+void FBXImporter::ReleasePreviousDB(bool success) {
+	if (prevDbPath.empty()) {
+		return;
+	}
+
+	std::error_code ec;
+	if (success) {
+		std::filesystem::remove(prevDbPath, ec);
+	}
+	else {
+		std::filesystem::remove(dbPath, ec);
+		std::filesystem::rename(prevDbPath, dbPath, ec);
+		if (ec) {
+			fprintf(stderr, "Unable to restore the previous database: %s\n", ec.message().c_str());
+		}
+	}
+	prevDbPath.clear();
+	prevFingerprints.clear();
+}
+
+/**
+ * Attempts to initialize the SQLite Database and FBX scene.
+ * Returns 0 on success, non-zero on error.
+ */
+int FBXImporter::Init(std::wstring fbxFilePath, sqlite3** database, FbxManager** manager, FbxScene** scene, FbxManager* sharedManager) {
+
+	auto utf = utf8_encode(fbxFilePath);
+	fprintf(stdout, "Attempting to process FBX: %ls\n", fbxFilePath.c_str());
 
+	// Importing into a model skips the DB entirely.
+	if (model == NULL) {
+		int rc = InitDB(database);
+		if (rc != 0) {
+			ReleasePreviousDB(false);
+			return rc;
+		}
+	}
 
-	// Create the FBX SDK manager
-	*manager = FbxManager::Create();
+	// Create the FBX SDK manager, unless we were handed one that's already set up.
+	if (sharedManager != NULL) {
+		*manager = sharedManager;
+		ownsManager = false;
+	}
+	else {
+		*manager = FbxManager::Create();
+		ownsManager = true;
 
-	// Create an IOSettings object.
-	FbxIOSettings* ios = FbxIOSettings::Create(*manager, IOSROOT);
-	(*manager)->SetIOSettings(ios);
+		// Create an IOSettings object.
+		FbxIOSettings* ios = FbxIOSettings::Create(*manager, IOSROOT);
+		(*manager)->SetIOSettings(ios);
+	}
 
 	// Create an importer.
 	FbxImporter* importer = FbxImporter::Create(*manager, "");
@@ -94,16 +206,27 @@ int FBXImporter::Init(std::wstring fbxFilePath, sqlite3** database, FbxManager**
 	// Declare the path and filename of the fidle containing the scene.
 	// In this case, we are assuming the file is in the same directory as the executable.
 
-	// Initialize the importer.
-	//auto stream = FbxStream:::Open()
+	// Initialize the importer, from memory if we were handed the file's contents.
+	int readerId = (*manager)->GetIOPluginRegistry()->FindReaderIDByExtension("fbx");
+	TTMemoryStream stream(sourceData, sourceSize, readerId);
 
-	bool success = importer->Initialize(utf.c_str(), -1, (*manager)->GetIOSettings());
+	bool success;
+	if (sourceData != NULL) {
+		success = importer->Initialize(&stream, NULL, readerId, (*manager)->GetIOSettings());
+	}
+	else {
+		success = importer->Initialize(utf.c_str(), -1, (*manager)->GetIOSettings());
+	}
 
 	// Use the first argument as the filename for the importer.
 	if (!success) {
 		fprintf(stderr, "Unable to load FBX file.");
+		importer->Destroy();
 		sqlite3_close(*database);
-		(*manager)->Destroy();
+		ReleasePreviousDB(false);
+		if (ownsManager) {
+			(*manager)->Destroy();
+		}
 		return 105;
 	}
 
@@ -117,360 +240,336 @@ int FBXImporter::Init(std::wstring fbxFilePath, sqlite3** database, FbxManager**
 	importer->Destroy();
 
 
-	auto unit = (*scene)->GetGlobalSettings().GetSystemUnit();
+	sourceUnit = (*scene)->GetGlobalSettings().GetSystemUnit();
+	sourceAxis = (*scene)->GetGlobalSettings().GetAxisSystem();
 
-	// Convert the scene to meters.
-	FbxSystemUnit::m.ConvertScene(*scene);
 	auto up = FbxAxisSystem::EUpVector::eYAxis;
 	auto front = FbxAxisSystem::EFrontVector::eParityOdd;
 	auto handedness = FbxAxisSystem::eRightHanded;
 	FbxAxisSystem dbAxis(up, front, handedness);
-	dbAxis.ConvertScene(*scene);
+
+	if (options.FuseConversion) {
+		// Leave the scene alone, the conversion is applied with the world transforms.
+		conversionMatrix = GetConversionMatrix(FbxSystemUnit::m, dbAxis);
+	}
+	else {
+		// Convert the scene to meters.
+		FbxSystemUnit::m.ConvertScene(*scene);
+		dbAxis.ConvertScene(*scene);
+		conversionMatrix.SetIdentity();
+	}
 
 	return 0;
 }
 
-
 /**
- * Shuts down the system gracefully.
+ * Gets the matrix that converting the scene to the given unit and axis system
+ * would have applied to every world transform.
+ * Rather than re-deriving the SDK's rules, this converts an empty scene with
+ * the same source settings and reads the result off a single node.
  */
-void FBXImporter::Shutdown(int code, const char* errorMessage) {
-
-	if (errorMessage != NULL) {
-		fprintf(stderr, "\nCritical Error: %s\n", errorMessage);
-	}
-
-	// Destroying the manger destroys the scene with it.
-	int whatever = manager->GetDocumentCount();
-	manager->Destroy();
+FbxAMatrix FBXImporter::GetConversionMatrix(const FbxSystemUnit& unit, const FbxAxisSystem& axis) {
+	FbxScene* probe = FbxScene::Create(manager, "conversion probe");
+	probe->GetGlobalSettings().SetSystemUnit(sourceUnit);
+	probe->GetGlobalSettings().SetAxisSystem(sourceAxis);
 
-	// Good night DB.
-	sqlite3_close(db);
+	FbxNode* node = FbxNode::Create(probe, "conversion probe");
+	probe->GetRootNode()->AddChild(node);
 
+	unit.ConvertScene(probe);
+	axis.ConvertScene(probe);
 
-	// Time for sleep.
-	exit(code);
+	FbxAMatrix conversion = node->EvaluateGlobalTransform();
+	probe->Destroy();
+	return conversion;
 }
 
 
-int FBXImporter::GetDirectIndex(FbxMesh* mesh, FbxLayerElementTemplate<FbxVector4>* layerElement, int index_id) {
+/**
+ * Shuts down the system gracefully.
+ * Returns the code the import finished with.
+ */
+int FBXImporter::Shutdown(int code, const char* errorMessage) {
 
-	if (layerElement == NULL) {
-		return -1;
+	if (errorMessage != NULL && errorMessage[0] != '\0') {
+		fprintf(stderr, "\nCritical Error: %s\n", errorMessage);
 	}
 
-	FbxLayerElement::EMappingMode mapMode = layerElement->GetMappingMode();
-	FbxLayerElement::EReferenceMode refMode = layerElement->GetReferenceMode();
-	// Pick which index we're using.
-	int index = 0;
-	if (mapMode == FbxLayerElement::eByControlPoint) {
-		index = mesh->GetPolygonVertex(index_id / 3, index_id % 3);
-	}
-	else if (mapMode == FbxLayerElement::eByPolygonVertex) {
-		index = index_id;
+	// Destroying the manger destroys the scene with it.
+	// A shared manager lives on for the next conversion, so only our scene goes.
+	if (ownsManager) {
+		manager->Destroy();
 	}
-	else {
-		return -1;
+	else if (scene != NULL) {
+		scene->Destroy();
 	}
+	manager = NULL;
+	scene = NULL;
 
-
-	FbxVector4 Normal;
-	// Run it through the appropriate direct/indirect
-	if (refMode == FbxLayerElement::eDirect) {
-		index = index;
-	}
-	else if (refMode == FbxLayerElement::eIndexToDirect) {
-		index = layerElement->GetIndexArray().GetAt(index);
-	}
-	else {
-		return -1;
+	// Nothing more to do when importing into a model.
+	if (db == NULL) {
+		return code;
 	}
-	return index;
-}
-
-int FBXImporter::GetDirectIndex(FbxMesh* mesh, FbxLayerElementTemplate<FbxVector2>* layerElement, int index_id) {
 
-	if (layerElement == NULL) {
-		return -1;
+	// Commit everything we've written.
+	if (!EndBulkWrite() && code == 0) {
+		code = 201;
 	}
 
-	FbxLayerElement::EMappingMode mapMode = layerElement->GetMappingMode();
-	FbxLayerElement::EReferenceMode refMode = layerElement->GetReferenceMode();
-	// Pick which index we're using.
-	int index = 0;
-	if (mapMode == FbxLayerElement::eByControlPoint) {
-		index = mesh->GetPolygonVertex(index_id / 3, index_id % 3);
-	}
-	else if (mapMode == FbxLayerElement::eByPolygonVertex) {
-		index = index_id;
-	}
-	else {
-		return -1;
+	if (options.MemoryDb && !SaveMemoryDb() && code == 0) {
+		code = 202;
 	}
 
+	// Good night DB.
+	sqlite3_close(db);
+	db = NULL;
+	ReleasePreviousDB(code == 0);
 
-	FbxVector4 Normal;
-	// Run it through the appropriate direct/indirect
-	if (refMode == FbxLayerElement::eDirect) {
-		index = index;
-	}
-	else if (refMode == FbxLayerElement::eIndexToDirect) {
-		index = layerElement->GetIndexArray().GetAt(index);
-	}
-	else {
-		return -1;
-	}
-	return index;
+	return code;
 }
 
-int FBXImporter::GetDirectIndex(FbxMesh* mesh, FbxLayerElementTemplate<FbxColor>* layerElement, int index_id) {
 
-	if (layerElement == NULL) {
-		return -1;
-	}
+/**
+ * Layer gather kernel, specialized for each mapping mode, reference mode and element type.
+ * Resolves the direct array index of every triangle index, then copies the values out.
+ * Returns false without copying the values if any direct index is out of range.
+ */
+template <FbxLayerElement::EMappingMode TMapping, FbxLayerElement::EReferenceMode TReference, typename T>
+static bool GatherKernel(const int* polygonVertices, const int* indexArray, int numIndices, const T* data, int count, T* values, int* directIndices) {
+	int minIndex = 0;
+	int maxIndex = 0;
 
-	FbxLayerElement::EMappingMode mapMode = layerElement->GetMappingMode();
-	FbxLayerElement::EReferenceMode refMode = layerElement->GetReferenceMode();
-	// Pick which index we're using.
-	int index = 0;
-	if (mapMode == FbxLayerElement::eByControlPoint) {
-		index = mesh->GetPolygonVertex(index_id / 3, index_id % 3);
+	for (int i = 0; i < numIndices; i++) {
+		int index;
+		if constexpr (TMapping == FbxLayerElement::eByControlPoint) {
+			index = polygonVertices[i];
+		}
+		else {
+			index = i;
+		}
+		if constexpr (TReference == FbxLayerElement::eIndexToDirect) {
+			index = indexArray[index];
+		}
+
+		directIndices[i] = index;
+		minIndex = index < minIndex ? index : minIndex;
+		maxIndex = index > maxIndex ? index : maxIndex;
 	}
-	else if (mapMode == FbxLayerElement::eByPolygonVertex) {
-		index = index_id;
+
+	if (minIndex < 0 || maxIndex >= count) {
+		return false;
 	}
-	else {
-		return -1;
+
+	for (int i = 0; i < numIndices; i++) {
+		values[i] = data[directIndices[i]];
 	}
+	return true;
+}
 
+template <typename T>
+using GatherKernelFn = bool(*)(const int*, const int*, int, const T*, int, T*, int*);
 
-	FbxVector4 Normal;
-	// Run it through the appropriate direct/indirect
-	if (refMode == FbxLayerElement::eDirect) {
-		index = index;
-	}
-	else if (refMode == FbxLayerElement::eIndexToDirect) {
-		index = layerElement->GetIndexArray().GetAt(index);
+// Picks the gather kernel for a layer element's mapping and reference modes.
+// Returns NULL for the modes we don't read values from.
+template <typename T>
+static GatherKernelFn<T> GetGatherKernel(FbxLayerElement::EMappingMode mapMode, FbxLayerElement::EReferenceMode refMode) {
+	if (mapMode == FbxLayerElement::eByControlPoint) {
+		if (refMode == FbxLayerElement::eDirect) {
+			return GatherKernel<FbxLayerElement::eByControlPoint, FbxLayerElement::eDirect, T>;
+		}
+		else if (refMode == FbxLayerElement::eIndexToDirect) {
+			return GatherKernel<FbxLayerElement::eByControlPoint, FbxLayerElement::eIndexToDirect, T>;
+		}
 	}
-	else {
-		return -1;
+	else if (mapMode == FbxLayerElement::eByPolygonVertex) {
+		if (refMode == FbxLayerElement::eDirect) {
+			return GatherKernel<FbxLayerElement::eByPolygonVertex, FbxLayerElement::eDirect, T>;
+		}
+		else if (refMode == FbxLayerElement::eIndexToDirect) {
+			return GatherKernel<FbxLayerElement::eByPolygonVertex, FbxLayerElement::eIndexToDirect, T>;
+		}
 	}
-	return index;
+	return NULL;
 }
 
-// Get the raw position value for a triangle index.
-FbxVector4 FBXImporter::GetPosition(FbxMesh* const mesh, int index_id) {
-	FbxVector4 def = FbxVector4(0, 0, 0, 0);
-	if (mesh->GetLayerCount() < 1) {
-		return def;
+// Resolves which layer element each vertex attribute is read from.
+void FBXImporter::MakeLayerPlan(FbxMesh* mesh, TTLayerPlan& plan) {
+	int layerCount = mesh->GetLayerCount();
+	plan.HasLayers = layerCount >= 1;
+	if (!plan.HasLayers) {
+		return;
 	}
-	FbxLayer* layer = mesh->GetLayer(0);
-	int vertex_id = mesh->GetPolygonVertex(index_id / 3, index_id % 3);
-	FbxVector4 position = mesh->GetControlPointAt(vertex_id);
-	return position;
-}
 
-// Get the raw normal value for a triangle index.
-FbxVector4 FBXImporter::GetNormal(FbxMesh* const mesh, int index_id) {
-	FbxVector4 def = FbxVector4(0, 0, 0, 1.0);
-	if (mesh->GetLayerCount() < 1) {
-		return def;
-	}
 	FbxLayer* layer = mesh->GetLayer(0);
-	FbxLayerElementNormal* layerElement = layer->GetNormals();
-	int index = GetDirectIndex(mesh, layerElement, index_id);
-	return index == -1 ? def : layerElement->GetDirectArray().GetAt(index);
-}
-
-// Get the raw binormal value for a triangle index.
-FbxVector4 FBXImporter::GetBinormal(FbxMesh* const mesh, int index_id) {
-	FbxVector4 def = FbxVector4(0, 0, 0, 1.0);
-	if (mesh->GetLayerCount() < 1) {
-		return def;
+	plan.Normals = layer->GetNormals();
+	plan.Binormals = layer->GetBinormals();
+	plan.Tangents = layer->GetTangents();
+
+	// UV channels N come from layer N.
+	for (int i = 0; i < 3; i++) {
+		if (layerCount > i) {
+			plan.UVs[i] = mesh->GetLayer(i)->GetUVs();
+		}
 	}
-	FbxLayer* layer = mesh->GetLayer(0);
-	FbxLayerElementBinormal* layerElement = layer->GetBinormals();
-	int index = GetDirectIndex(mesh, layerElement, index_id);
-	return index == -1 ? def : layerElement->GetDirectArray().GetAt(index);
-}
 
-// Get the raw binormal value for a triangle index.
-FbxVector4 FBXImporter::GetTangent(FbxMesh* const mesh, int index_id) {
-	FbxVector4 def = FbxVector4(0, 0, 0, 1.0);
-	if (mesh->GetLayerCount() < 1) {
-		return def;
+	// The first vertex color channel comes from layer 0, while the second
+	// and third are the second and third vertex color channels in any layer.
+	plan.Colors[0] = layer->GetVertexColors();
+	int colorsFound = 0;
+	for (int i = 0; i < layerCount; i++) {
+		FbxLayerElementVertexColor* layerElement = mesh->GetLayer(i)->GetVertexColors();
+		if (layerElement == NULL) {
+			continue;
+		}
+		colorsFound++;
+		if (colorsFound == 2) {
+			plan.Colors[1] = layerElement;
+		}
+		else if (colorsFound == 3) {
+			plan.Colors[2] = layerElement;
+		}
 	}
-	FbxLayer* layer = mesh->GetLayer(0);
-	FbxLayerElementTangent* layerElement = layer->GetTangents();
-	int index = GetDirectIndex(mesh, layerElement, index_id);
-	return index == -1 ? def : layerElement->GetDirectArray().GetAt(index);
 }
 
-// Get the raw uv1 value for a triangle index.
-FbxVector2 FBXImporter::GetUV1(FbxMesh* const mesh, int index_id) {
-	FbxVector2 def = FbxVector2(0, 0);
-	if (mesh->GetLayerCount() < 1) {
-		return def;
-	}
-	FbxLayer* layer = mesh->GetLayer(0);
-	FbxLayerElementUV* uvs = layer->GetUVs();
-	int index = GetDirectIndex(mesh, uvs, index_id);
-	return index == -1 ? def : uvs->GetDirectArray().GetAt(index);
-}
+// Gathers the value of a layer element for every triangle index.
+// Indices the element has no value for get the default value.
+template <typename T>
+void FBXImporter::GatherLayer(const int* polygonVertices, int numIndices, int maxControlPoint, FbxLayerElementTemplate<T>* layerElement, const T& def, std::vector<T>& values, std::vector<int>* directIndices) {
+	values.resize(numIndices);
 
-// Get the raw uv1 value for a triangle index.
-int FBXImporter::GetUV1Index(FbxMesh* const mesh, int index_id) {
-	FbxVector2 def = FbxVector2(0, 0);
-	if (mesh->GetLayerCount() < 1) {
-		return -1;
+	std::vector<int> localIndices;
+	if (directIndices == NULL) {
+		directIndices = &localIndices;
 	}
+	directIndices->resize(numIndices);
 
-	FbxLayer* layer = mesh->GetLayer(0);
-	FbxLayerElementUV* uvs = layer->GetUVs();
-
-
-	return GetDirectIndex(mesh, uvs, index_id);
-}
+	GatherKernelFn<T> kernel = NULL;
+	if (layerElement != NULL) {
+		kernel = GetGatherKernel<T>(layerElement->GetMappingMode(), layerElement->GetReferenceMode());
+	}
 
-// Get the raw uv1 value for a triangle index.
-int FBXImporter::GetUV2Index(FbxMesh* const mesh, int index_id) {
-	FbxVector2 def = FbxVector2(0, 0);
-	if (mesh->GetLayerCount() < 2) {
-		return -1;
+	if (kernel == NULL) {
+		std::fill(values.begin(), values.end(), def);
+		std::fill(directIndices->begin(), directIndices->end(), -1);
+		return;
 	}
 
-	FbxLayer* layer = mesh->GetLayer(1);
-	FbxLayerElementUV* uvs = layer->GetUVs();
+	FbxLayerElementArrayTemplate<T>& directArray = layerElement->GetDirectArray();
+	FbxLayerElementArrayTemplate<int>& indexArray = layerElement->GetIndexArray();
+	bool indexed = layerElement->GetReferenceMode() == FbxLayerElement::eIndexToDirect;
+	int maxSource = layerElement->GetMappingMode() == FbxLayerElement::eByControlPoint ? maxControlPoint : numIndices - 1;
 
-	return GetDirectIndex(mesh, uvs, index_id);
-}
+	int count = directArray.GetCount();
+	T* data = directArray.GetLocked(FbxLayerElementArray::eReadLock);
+	int* indices = indexed ? indexArray.GetLocked(FbxLayerElementArray::eReadLock) : NULL;
 
-// Get the raw uv2 value for a triangle index.
-FbxVector2 FBXImporter::GetUV2(FbxMesh* const mesh, int index_id) {
-	FbxVector2 def = FbxVector2(0, 0);
-	if (mesh->GetLayerCount() < 2) {
-		return def;
+	bool gathered = false;
+	if (!indexed || (indices != NULL && maxSource < indexArray.GetCount())) {
+		gathered = kernel(polygonVertices, indices, numIndices, data, count, values.data(), directIndices->data());
 	}
-	FbxLayer* layer = mesh->GetLayer(1);
-	FbxLayerElementUV* uvs = layer->GetUVs();
-	int index = GetDirectIndex(mesh, uvs, index_id);
-	return index == -1 ? def : uvs->GetDirectArray().GetAt(index);
-}
-
-// Get the raw uv1 value for a triangle index.
-int FBXImporter::GetUV3Index(FbxMesh* const mesh, int index_id) {
-	FbxVector2 def = FbxVector2(0, 0);
-	if (mesh->GetLayerCount() < 3) {
-		return -1;
+	else {
+		// Index array doesn't cover the mesh; let the SDK deal with it the same way it always has.
+		for (int i = 0; i < numIndices; i++) {
+			int index = layerElement->GetMappingMode() == FbxLayerElement::eByControlPoint ? polygonVertices[i] : i;
+			(*directIndices)[i] = indexArray.GetAt(index);
+		}
 	}
 
-	FbxLayer* layer = mesh->GetLayer(2);
-	FbxLayerElementUV* uvs = layer->GetUVs();
+	if (!gathered) {
+		// Some direct index is out of range, so go through the checked path.
+		for (int i = 0; i < numIndices; i++) {
+			int index = (*directIndices)[i];
+			if (index == -1) {
+				values[i] = def;
+			}
+			else if (data != NULL && index >= 0 && index < count) {
+				values[i] = data[index];
+			}
+			else {
+				values[i] = directArray.GetAt(index);
+			}
+		}
+	}
 
-	return GetDirectIndex(mesh, uvs, index_id);
+	if (indices != NULL) {
+		indexArray.Release(&indices);
+	}
+	if (data != NULL) {
+		directArray.Release(&data);
+	}
 }
 
-// Get the raw uv2 value for a triangle index.
-FbxVector2 FBXImporter::GetUV3(FbxMesh* const mesh, int index_id) {
-	FbxVector2 def = FbxVector2(0, 0);
-	auto ct = mesh->GetLayerCount();
-	if (mesh->GetLayerCount() < 3) {
-		return def;
-	}
-	FbxLayer* layer = mesh->GetLayer(2);
-	FbxLayerElementUV* uvs = layer->GetUVs();
-	int index = GetDirectIndex(mesh, uvs, index_id);
-	return index == -1 ? def : uvs->GetDirectArray().GetAt(index);
-}
+// Gathers every vertex attribute for every triangle index of the mesh.
+void FBXImporter::GatherAttributes(FbxMesh* mesh, const TTLayerPlan& plan, TTMeshAttributes& attributes) {
+	int numIndices = mesh->GetPolygonVertexCount();
+	const int* polygonVertices = mesh->GetPolygonVertices();
 
-// Gets the raw vertex color value for a triangle index.
-FbxColor FBXImporter::GetVertexColor(FbxMesh* const mesh, int index_id) {
-	FbxColor def = FbxColor(1, 1, 1, 1);
-	if (mesh->GetLayerCount() < 1) {
-		return def;
+	int maxControlPoint = 0;
+	for (int i = 0; i < numIndices; i++) {
+		maxControlPoint = polygonVertices[i] > maxControlPoint ? polygonVertices[i] : maxControlPoint;
 	}
-	FbxLayer* layer = mesh->GetLayer(0);
-	FbxLayerElementVertexColor* layerElement = layer->GetVertexColors();
-	int index = GetDirectIndex(mesh, layerElement, index_id);
-	return index == -1 ? def : layerElement->GetDirectArray().GetAt(index);
-}
 
-// Gets the raw vertex color value for a triangle index.
-FbxColor FBXImporter::GetVertexColor2(FbxMesh* const mesh, int index_id) {
-	FbxColor def = FbxColor(0, 0, 0, 1);
-	if (mesh->GetLayerCount() < 1) {
-		return def;
+	// Positions come straight from the control points.
+	attributes.Positions.resize(numIndices);
+	if (plan.HasLayers) {
+		const FbxVector4* controlPoints = mesh->GetControlPoints();
+		for (int i = 0; i < numIndices; i++) {
+			attributes.Positions[i] = controlPoints[polygonVertices[i]];
+		}
+	}
+	else {
+		std::fill(attributes.Positions.begin(), attributes.Positions.end(), FbxVector4(0, 0, 0, 0));
 	}
-	auto layerCount = mesh->GetLayerCount();
 
-	// Scan all the layers above 0 for vertex color channels
-	
-	int colorsFound = 0;
-	for (int i = 0; i < layerCount; i++) {
-		FbxLayer* layer = mesh->GetLayer(i);
-		FbxLayerElementVertexColor* layerElement = layer->GetVertexColors();
-		if (layerElement == NULL) {
-			continue;
-		}
-		colorsFound++;
-		if (colorsFound == 2) {
-			int index = GetDirectIndex(mesh, layerElement, index_id);
-			def = index == -1 ? def : layerElement->GetDirectArray().GetAt(index);
-		}
+	GatherLayer(polygonVertices, numIndices, maxControlPoint, plan.Normals, FbxVector4(0, 0, 0, 1.0), attributes.Normals);
+	GatherLayer(polygonVertices, numIndices, maxControlPoint, plan.Binormals, FbxVector4(0, 0, 0, 1.0), attributes.Binormals);
+	GatherLayer(polygonVertices, numIndices, maxControlPoint, plan.Tangents, FbxVector4(0, 0, 0, 1.0), attributes.Tangents);
+
+	for (int i = 0; i < 3; i++) {
+		GatherLayer(polygonVertices, numIndices, maxControlPoint, plan.UVs[i], FbxVector2(0, 0), attributes.UVs[i], &attributes.UVIndices[i]);
 	}
 
-	return def;
+	GatherLayer(polygonVertices, numIndices, maxControlPoint, plan.Colors[0], FbxColor(1, 1, 1, 1), attributes.Colors[0]);
+	GatherLayer(polygonVertices, numIndices, maxControlPoint, plan.Colors[1], FbxColor(0, 0, 0, 1), attributes.Colors[1]);
+	GatherLayer(polygonVertices, numIndices, maxControlPoint, plan.Colors[2], FbxColor(0.5, 0.5, 1, 1), attributes.Colors[2]);
 }
 
-// Gets the raw vertex color value for a triangle index.
-FbxColor FBXImporter::GetVertexColor3(FbxMesh* const mesh, int index_id) {
-	FbxColor def = FbxColor(0.5, 0.5, 1, 1);
-	if (mesh->GetLayerCount() < 2) {
-		return def;
+// Retreives the shared bone Id for a given bone name id (added to the bone Id list if needed)
+int FBXImporter::GetBoneId(int mesh, int boneName) {
+	while (meshBones.size() <= (unsigned int)mesh) {
+		meshBones.emplace_back();
+		meshBoneIds.emplace_back();
 	}
-	auto layerCount = mesh->GetLayerCount();
 
-	// Scan all the layers above 0 for vertex color channels
-
-	int colorsFound = 0;
-	for (int i = 0; i < layerCount; i++) {
-		FbxLayer* layer = mesh->GetLayer(i);
-		FbxLayerElementVertexColor* layerElement = layer->GetVertexColors();
-		if (layerElement == NULL) {
-			continue;
-		}
-		colorsFound++;
-		if (colorsFound == 3) {
-			int index = GetDirectIndex(mesh, layerElement, index_id);
-			def = index == -1 ? def : layerElement->GetDirectArray().GetAt(index);
-		}
+	auto it = meshBoneIds[mesh].find(boneName);
+	if (it != meshBoneIds[mesh].end()) {
+		return it->second;
 	}
 
-	return def;
+	int boneIdx = meshBones[mesh].size();
+	meshBones[mesh].push_back(boneName);
+	meshBoneIds[mesh].emplace(boneName, boneIdx);
+	return boneIdx;
 }
 
-// Retreives the shared bone Id for a given bone (added to the bone Id list if needed)
-int FBXImporter::GetBoneId(int mesh, std::string boneName) {
-	while (boneNames.size() <= (unsigned int)mesh) {
-		std::vector<std::string> n;
-		boneNames.push_back(n);
+// Retreives the job-local bone Id for a given bone (added to the job's bone list if needed)
+int FBXImporter::GetLocalBoneId(TTNodeJob* job, const char* boneName) {
+	int name;
+	{
+		// Jobs on other threads may be adding names too.
+		std::lock_guard<std::mutex> lock(nameMutex);
+		name = boneNameTable.Intern(boneName);
 	}
 
-	// Get
-	int boneIdx = -1;
-	for (unsigned int ni = 0; ni < boneNames[mesh].size(); ni++) {
-		std::string bName = boneNames[mesh][ni];
-		if (bName.compare(boneName) == 0) {
-			boneIdx = ni;
-			break;
+	// Meshes only use a handful of bones, so a scan over ints is plenty.
+	for (unsigned int ni = 0; ni < job->BoneNames.size(); ni++) {
+		if (job->BoneNames[ni] == name) {
+			return ni;
 		}
 	}
 
-	if (boneIdx == -1) {
-		boneNames[mesh].push_back(boneName);
-		boneIdx = boneNames[mesh].size() - 1;
-	}
-	return boneIdx;
+	job->BoneNames.push_back(name);
+	return job->BoneNames.size() - 1;
 }
 
 // Gets the first Skin element in a mesh.
@@ -509,7 +608,7 @@ void FBXImporter::RunSql(std::string query) {
 	if (result != SQLITE_OK) {
 		fprintf(stderr, "SQLite Error: %s", err);
 		sqlite3_free(err);
-		Shutdown(201, "SQLite Error.");
+		throw TTError(201, "SQLite Error.");
 	}
 }
 
@@ -520,16 +619,11 @@ void FBXImporter::RunSql(sqlite3_stmt* statement) {
 	if (result != SQLITE_DONE) {
 		std::string err = sqlite3_errmsg(db);
 		fprintf(stderr, "SQLite Error: %s", err.c_str());
-		sqlite3_finalize(statement);
-		Shutdown(201, "SQLite Error.");
 	}
 	sqlite3_reset(statement);
 	sqlite3_clear_bindings(statement);
 	if (result != SQLITE_DONE) {
-		std::string err = sqlite3_errmsg(db);
-		fprintf(stderr, "SQLite Error: %s", err.c_str());
-		sqlite3_finalize(statement);
-		Shutdown(201, "SQLite Error.");
+		throw TTError(201, "SQLite Error.");
 	}
 }
 
@@ -540,16 +634,102 @@ sqlite3_stmt* FBXImporter::MakeSqlStatement(std::string query) {
 	return stmt;
 }
 
+// Gets the prepared statement for a query string, preparing it the first time it's used.
+// Statements are kept until the DB is closed, so callers must not finalize them.
+sqlite3_stmt* FBXImporter::GetStatement(const std::string& query) {
+	std::map<std::string, sqlite3_stmt*>::iterator it = statements.find(query);
+	if (it != statements.end()) {
+		return it->second;
+	}
+
+	sqlite3_stmt* stmt = MakeSqlStatement(query);
+	statements.insert({ query, stmt });
+	return stmt;
+}
+
+/**
+ * Finalizes the cached statements, commits the import's transaction and
+ * restores the durable DB settings.
+ * Returns false if the commit failed.
+ */
+bool FBXImporter::EndBulkWrite() {
+	for (auto it = statements.begin(); it != statements.end(); ++it) {
+		sqlite3_finalize(it->second);
+	}
+	statements.clear();
+
+	bool success = true;
+	char* err = NULL;
+	if (sqlite3_get_autocommit(db) == 0) {
+		if (sqlite3_exec(db, "COMMIT;", NULL, 0, &err) != SQLITE_OK) {
+			fprintf(stderr, "SQLite Error: %s", err);
+			sqlite3_free(err);
+			success = false;
+		}
+	}
+
+	if (sqlite3_exec(db, durablePragmas, NULL, 0, &err) != SQLITE_OK) {
+		fprintf(stderr, "SQLite Error: %s", err);
+		sqlite3_free(err);
+	}
+	return success;
+}
+
+/**
+ * Writes the in-memory DB out to the DB file.
+ * The serialized image goes out in one sequential write; if SQLite can't
+ * serialize it, the backup API copies it page by page instead.
+ * Returns false if the file couldn't be written.
+ */
+bool FBXImporter::SaveMemoryDb() {
+	sqlite3_int64 size = 0;
+	unsigned char* image = sqlite3_serialize(db, "main", &size, 0);
+
+	if (image != NULL) {
+		std::ofstream file(std::filesystem::path(dbPath), std::ios::binary);
+		file.write((const char*)image, (std::streamsize)size);
+		file.close();
+		bool success = !file.fail();
+		sqlite3_free(image);
+
+		if (!success) {
+			fprintf(stderr, "Unable to write database file.\n");
+		}
+		return success;
+	}
+
+	sqlite3* fileDb;
+	int rc = sqlite3_open(utf8_encode(dbPath).c_str(), &fileDb);
+	if (rc == SQLITE_OK) {
+		sqlite3_backup* backup = sqlite3_backup_init(fileDb, "main", db, "main");
+		if (backup != NULL) {
+			sqlite3_backup_step(backup, -1);
+			sqlite3_backup_finish(backup);
+		}
+		rc = sqlite3_errcode(fileDb);
+	}
+
+	if (rc != SQLITE_OK) {
+		fprintf(stderr, "Unable to write database file: %s\n", sqlite3_errmsg(fileDb));
+	}
+	sqlite3_close(fileDb);
+	return rc == SQLITE_OK;
+}
+
 // Write a non-critical warning message to the DB and stdout.
 void FBXImporter::WriteWarning(std::string warning) {
 	fprintf(stderr, "Warning: %s\n", warning.c_str());
 
+	if (model != NULL) {
+		model->Warnings.push_back(warning);
+		return;
+	}
+
 	// Load the triangle indicies into the SQLite DB.
 	std::string insertStatement = "insert into warnings (text) values (?1)";
-	sqlite3_stmt* query = MakeSqlStatement(insertStatement);
+	sqlite3_stmt* query = GetStatement(insertStatement);
 	sqlite3_bind_text(query, 1, warning.c_str(), warning.length(), NULL);
 	RunSql(query);
-	sqlite3_finalize(query);
 }
 
 bool FBXImporter::MeshGroupExists(int mesh) {
@@ -586,16 +766,6 @@ void FBXImporter::MakeMeshPart(int mesh, int part, std::string name, std::string
 	if (it == meshParts.end()) {
 		partList = std::map<int, std::string>();
 		meshParts.insert(make_pair(mesh, partList));
-
-		// Pop the name and entry into the DB too.
-		// We don't really care about having an accurate material ID here, as TexTools doesn't read it on
-		// import anyways.
-		std::string insertStatement = "insert into meshes (mesh, name, material_id, model) values (?1, ?2, 0, 0)";
-		sqlite3_stmt* query = MakeSqlStatement(insertStatement);
-		sqlite3_bind_int(query, 1, mesh);
-		sqlite3_bind_text(query, 2, parentName.c_str(), parentName.length(), NULL);
-		RunSql(query);
-		sqlite3_finalize(query);
 	}
 	else {
 		partList = it->second;
@@ -604,17 +774,37 @@ void FBXImporter::MakeMeshPart(int mesh, int part, std::string name, std::string
 	// Insert mesh name
 	partList.insert(make_pair(part, name));
 	meshParts[mesh] = partList;
+}
 
-	// Insert the part into the SQlite DB.
+// Writes a mesh part (and its mesh group, if this is the group's first part) to the DB.
+void FBXImporter::WriteMeshPart(int mesh, int part, std::string name, std::string parentName, bool newMeshGroup) {
+
+	if (model != NULL) {
+		if (newMeshGroup) {
+			model->GetMeshGroup(mesh)->Name = parentName;
+		}
+		model->GetPart(mesh, part)->Name = name;
+		return;
+	}
+
+	if (newMeshGroup) {
+		// Pop the name and entry into the DB too.
+		// We don't really care about having an accurate material ID here, as TexTools doesn't read it on
+		// import anyways.
+		std::string insertStatement = "insert into meshes (mesh, name, material_id, model) values (?1, ?2, 0, 0)";
+		sqlite3_stmt* query = GetStatement(insertStatement);
+		sqlite3_bind_int(query, 1, mesh);
+		sqlite3_bind_text(query, 2, parentName.c_str(), parentName.length(), NULL);
+		RunSql(query);
+	}
 
 	// Load the Part into the SQLite DB.
 	std::string insertStatement = "insert into parts (mesh, part, name) values (?1, ?2, ?3)";
-	sqlite3_stmt* query = MakeSqlStatement(insertStatement);
+	sqlite3_stmt* query = GetStatement(insertStatement);
 	sqlite3_bind_int(query, 1, mesh);
 	sqlite3_bind_int(query, 2, part);
 	sqlite3_bind_text(query, 3, name.c_str(), name.length(), NULL);
 	RunSql(query);
-	sqlite3_finalize(query);
 }
 
 static bool NearlyEqual(FbxVector4 a, FbxVector4 b) {
@@ -637,23 +827,32 @@ static bool NearlyEqual(FbxVector4 a, FbxVector4 b) {
 }
 
 /**
- * Saves the given node to the SQLite DB.
+ * Checks the given node and queues it for extraction.
+ * Anything that depends on the order nodes are visited in (mesh/part numbering,
+ * duplicate detection) is resolved here, on the scanning thread.
  */
-void FBXImporter::SaveNode(FbxNode* node) {
-	FbxMesh* mesh = node->GetMesh();
-	std::string meshName = node->GetName();
+void FBXImporter::QueueNode(FbxNode* node) {
+	TTNodeJob* job = new TTNodeJob();
+	job->Node = node;
+	job->Mesh = node->GetMesh();
+	job->MeshName = node->GetName();
+	jobs.push_back(job);
+
+	FbxMesh* mesh = job->Mesh;
+	std::string meshName = job->MeshName;
 
 	int numVertices = mesh->GetControlPointsCount();
 	int numIndices = mesh->GetPolygonVertexCount();
 	if (numIndices == 0 || numVertices == 0) {
 		// Mesh does not actually have any tris.
-		WriteWarning("Ignored mesh: " + meshName + " - Mesh had no vertices/triangles.");
+		job->Log.push_back({ TTLogEntry::eWarning, "Ignored mesh: " + meshName + " - Mesh had no vertices/triangles." });
+		job->Skip = true;
 		return;
 	}
 	FbxSkin* skin = GetSkin(mesh);
 	if (skin == NULL) {
 		// Mesh does not actually have a skin.
-		WriteWarning("Mesh: " + meshName + " - Does not have a valid skin element.  This will cause animation issues if this is intended to be an animated mesh.");
+		job->Log.push_back({ TTLogEntry::eWarning, "Mesh: " + meshName + " - Does not have a valid skin element.  This will cause animation issues if this is intended to be an animated mesh." });
 	}
 
 
@@ -664,7 +863,10 @@ void FBXImporter::SaveNode(FbxNode* node) {
 	bool success = std::regex_match(meshName, m, extractMeshInfoRegex);
 
 	// Somehow we got here with a badly named mesh.
-	if (!success) return;
+	if (!success) {
+		job->Skip = true;
+		return;
+	}
 
 	std::string meshMatch = m[1];
 	std::string partMatch = m[2];
@@ -678,7 +880,8 @@ void FBXImporter::SaveNode(FbxNode* node) {
 
 	if (MeshPartExists(meshNum, partNum)) {
 		// Mesh part already exists.
-		WriteWarning("Ignored mesh: " + meshName + " - Mesh " + std::to_string(meshNum) + " Part " + std::to_string(partNum) + " already exists.");
+		job->Log.push_back({ TTLogEntry::eWarning, "Ignored mesh: " + meshName + " - Mesh " + std::to_string(meshNum) + " Part " + std::to_string(partNum) + " already exists." });
+		job->Skip = true;
 		return;
 	}
 
@@ -688,58 +891,253 @@ void FBXImporter::SaveNode(FbxNode* node) {
 	}
 
 	// Add the mesh part.
+	job->NewMeshGroup = !MeshGroupExists(meshNum);
 	MakeMeshPart(meshNum, partNum, meshName, parentName);
 
-	// Create a vector the side of the control point array to store the weights.
-	std::vector<TTWeightSet> weightSets;
-	weightSets.resize(mesh->GetControlPointsCount());
+	job->MeshNum = meshNum;
+	job->PartNum = partNum;
+	job->ParentName = parentName;
+
+	// Transform evaluation goes through the scene's shared evaluator, so it
+	// has to happen here rather than on the workers.
+	job->WorldTransform = node->EvaluateGlobalTransform();
+	if (options.FuseConversion) {
+		job->WorldTransform = conversionMatrix * job->WorldTransform;
+	}
+	job->NormalMatrix = job->WorldTransform.Inverse().Transpose();
+
+	// Meshes instanced by more than one node have to be extracted in order.
+	std::map<FbxMesh*, int>::iterator it = meshJobs.find(mesh);
+	if (it != meshJobs.end()) {
+		job->DependsOn = it->second;
+		job->SharedMesh = true;
+		jobs[it->second]->SharedMesh = true;
+	}
+	meshJobs[mesh] = jobs.size() - 1;
+}
+
+// Hashes a layer element's mapping and its direct and index arrays, as they sit in memory.
+template <typename T>
+static void HashLayer(TTHash64& hash, FbxLayerElementTemplate<T>* layerElement) {
+	if (layerElement == NULL) {
+		hash.UpdateValue((int32_t)-1);
+		return;
+	}
+	hash.UpdateValue((int32_t)layerElement->GetMappingMode());
+	hash.UpdateValue((int32_t)layerElement->GetReferenceMode());
+
+	FbxLayerElementArrayTemplate<T>& directArray = layerElement->GetDirectArray();
+	int count = directArray.GetCount();
+	hash.UpdateValue((int32_t)count);
+	T* data = directArray.GetLocked(FbxLayerElementArray::eReadLock);
+	if (data != NULL) {
+		hash.Update(data, count * sizeof(T));
+		directArray.Release(&data);
+	}
+
+	if (layerElement->GetReferenceMode() == FbxLayerElement::eIndexToDirect) {
+		FbxLayerElementArrayTemplate<int>& indexArray = layerElement->GetIndexArray();
+		count = indexArray.GetCount();
+		hash.UpdateValue((int32_t)count);
+		int* indices = indexArray.GetLocked(FbxLayerElementArray::eReadLock);
+		if (indices != NULL) {
+			hash.Update(indices, count * sizeof(int));
+			indexArray.Release(&indices);
+		}
+	}
+}
+
+/**
+ * Hashes everything ExtractNode reads for the node: its transforms, control points,
+ * polygon vertices, layer elements, skin clusters and shapes, along with the options
+ * that change what they extract to.
+ * Must run before extraction, which bakes active blends into the control points.
+ */
+uint64_t FBXImporter::FingerprintNode(TTNodeJob* job) {
+	FbxMesh* mesh = job->Mesh;
+	TTHash64 hash;
+
+	hash.UpdateValue((uint32_t)_TT_Fingerprint_Version);
+	hash.UpdateValue((uint8_t)options.FuseConversion);
+	hash.UpdateValue((uint8_t)options.ColumnarDb);
+	hash.UpdateValue((int32_t)options.MaxWeights);
+
+	for (int r = 0; r < 4; r++) {
+		for (int c = 0; c < 4; c++) {
+			hash.UpdateValue(job->WorldTransform.Get(r, c));
+			hash.UpdateValue(job->NormalMatrix.Get(r, c));
+		}
+	}
+
+	int controlPointCount = mesh->GetControlPointsCount();
+	hash.UpdateValue((int32_t)controlPointCount);
+	hash.Update(mesh->GetControlPoints(), controlPointCount * sizeof(FbxVector4));
+
+	int numIndices = mesh->GetPolygonVertexCount();
+	hash.UpdateValue((int32_t)mesh->GetPolygonCount());
+	hash.UpdateValue((int32_t)numIndices);
+	hash.Update(mesh->GetPolygonVertices(), numIndices * sizeof(int));
+
+	// Only the layer elements extraction actually reads from.
+	TTLayerPlan plan;
+	MakeLayerPlan(mesh, plan);
+	HashLayer(hash, plan.Normals);
+	HashLayer(hash, plan.Binormals);
+	HashLayer(hash, plan.Tangents);
+	for (int i = 0; i < 3; i++) {
+		HashLayer(hash, plan.UVs[i]);
+		HashLayer(hash, plan.Colors[i]);
+	}
+
+	FbxSkin* skin = GetSkin(mesh);
+	int numClusters = skin != NULL ? skin->GetClusterCount() : -1;
+	hash.UpdateValue((int32_t)numClusters);
+	for (int i = 0; i < numClusters; i++) {
+		FbxCluster* cluster = skin->GetCluster(i);
+		int affectedVertCount = cluster->GetControlPointIndicesCount();
+		hash.UpdateValue((int32_t)affectedVertCount);
+		if (affectedVertCount == 0) continue;
+
+		hash.UpdateString(cluster->GetLink()->GetName());
+		hash.Update(cluster->GetControlPointIndices(), affectedVertCount * sizeof(int));
+		hash.Update(cluster->GetControlPointWeights(), affectedVertCount * sizeof(double));
+	}
+
+	// Every blend shape deformer, in order, since active blends are applied to the base mesh.
+	int deformerCount = mesh->GetDeformerCount();
+	for (int i = 0; i < deformerCount; i++) {
+		FbxDeformer* d = mesh->GetDeformer(i);
+		if (d->GetDeformerType() != FbxDeformer::eBlendShape) {
+			continue;
+		}
+
+		FbxBlendShape* morpher = (FbxBlendShape*)d;
+		int channelCount = morpher->GetBlendShapeChannelCount();
+		hash.UpdateValue((int32_t)channelCount);
+		for (int ci = 0; ci < channelCount; ci++) {
+			FbxBlendShapeChannel* channel = morpher->GetBlendShapeChannel(ci);
+			double pct = channel->DeformPercent;
+			hash.UpdateValue(pct);
+
+			int shapeCount = channel->GetTargetShapeCount();
+			hash.UpdateValue((int32_t)shapeCount);
+			for (int si = 0; si < shapeCount; si++) {
+				FbxShape* fbxShape = channel->GetTargetShape(si);
+				int shapePointCount = fbxShape->GetControlPointsCount();
+				hash.UpdateString(fbxShape->GetName());
+				hash.UpdateValue((int32_t)shapePointCount);
+				hash.Update(fbxShape->GetControlPoints(), shapePointCount * sizeof(FbxVector4));
+			}
+		}
+	}
+
+	return hash.Digest();
+}
+
+/**
+ * Converts the given node's geometry into TT format.
+ * This does not touch the DB or any importer state shared between nodes,
+ * so it may run on any worker thread.
+ */
+void FBXImporter::ExtractNode(TTNodeJob* job) {
+	if (job->Skip) {
+		return;
+	}
+
+	// Fingerprint the part for the next incremental import, and skip it entirely
+	// if it's the same as last time.  Shared meshes are extracted in order and
+	// alter each other's control points, so they're always extracted.
+	// A part that's already fingerprinted is only extracted again if it couldn't be copied.
+	if (model == NULL && !job->SharedMesh && job->Fingerprint == 0) {
+		job->Fingerprint = FingerprintNode(job);
+
+		auto it = prevFingerprints.find({ job->MeshNum, job->PartNum });
+		if (it != prevFingerprints.end() && it->second == job->Fingerprint) {
+			job->Reused = true;
+			return;
+		}
+	}
+
+	FbxNode* node = job->Node;
+	FbxMesh* mesh = job->Mesh;
+	std::string meshName = job->MeshName;
+	FbxSkin* skin = GetSkin(mesh);
 
-	// Vector of [control point index] => [Set of tri indexes that reference it.
-	std::vector<std::vector<int>> controlToPolyArray;
-	controlToPolyArray.resize(mesh->GetControlPointsCount());
+	int numIndices = mesh->GetPolygonVertexCount();
+
+	int controlPointCount = mesh->GetControlPointsCount();
+
+	// Weights for every control point.
+	TTWeightAccumulator weights(controlPointCount, options.MaxWeights);
 	int polys = mesh->GetPolygonCount();
 	if (polys != (numIndices / 3.0f)) {
-		Shutdown(500, "FBX is not fully triangulated.  Please export from your 3D modeling program with Triangulate option enabled.");
+		job->ErrorCode = 500;
+		job->ErrorMessage = "FBX is not fully triangulated.  Please export from your 3D modeling program with Triangulate option enabled.";
+		return;
 	}
 
-	// Loop all tri indices and add them to the appropriate array.
+	const int* polygonVertices = mesh->GetPolygonVertices();
+
+	// [control point index] => [Set of tri indexes that reference it], in CSR form.
+	// The tri indexes of control point cpi are polyIndices[polyStart[cpi]] up to polyIndices[polyStart[cpi + 1]].
+	std::vector<int> polyStart(controlPointCount + 1, 0);
+	std::vector<int> polyIndices(numIndices);
+
+	// Count the tri indices of each control point, then loop them again to place them in order.
+	for (int i = 0; i < numIndices; i++) {
+		polyStart[polygonVertices[i] + 1]++;
+	}
+	for (int cpi = 0; cpi < controlPointCount; cpi++) {
+		polyStart[cpi + 1] += polyStart[cpi];
+	}
+	std::vector<int> polyFill(polyStart.begin(), polyStart.end() - 1);
 	for (int i = 0; i < numIndices; i++) {
-		int controlPointIndex = mesh->GetPolygonVertex(i / 3, i % 3);
-		controlToPolyArray[controlPointIndex].push_back(i);
+		polyIndices[polyFill[polygonVertices[i]]++] = i;
 	}
 
 	if (skin != NULL) {
 		int numClusters = skin->GetClusterCount();
 		// Loop all the clusters and populate the weight sets.
 		for (int i = 0; i < numClusters; i++) {
-			FbxCluster::ELinkMode mode = skin->GetCluster(i)->GetLinkMode();
-			std::string name = skin->GetCluster(i)->GetLink()->GetName();
-			int affectedVertCount = skin->GetCluster(i)->GetControlPointIndicesCount();
-
-
-
+			FbxCluster* cluster = skin->GetCluster(i);
+			int affectedVertCount = cluster->GetControlPointIndicesCount();
 			if (affectedVertCount == 0) continue;
 
-			int boneIdx = GetBoneId(meshNum, name);
-
+			int boneIdx = GetLocalBoneId(job, cluster->GetLink()->GetName());
 
+			const int* cpIndices = cluster->GetControlPointIndices();
+			const double* cpWeights = cluster->GetControlPointWeights();
 			for (int vi = 0; vi < affectedVertCount; vi++) {
-				int cpIndex = skin->GetCluster(i)->GetControlPointIndices()[vi];
-				double weight = skin->GetCluster(i)->GetControlPointWeights()[vi];
+				int cpIndex = cpIndices[vi];
+				double weight = cpWeights[vi];
 				if (weight > _MINIMUM_WEIGHT_VALUE) {
-					if (cpIndex < weightSets.size()) {
-						weightSets[cpIndex].Add(boneIdx, weight);
+					if (cpIndex >= 0 && cpIndex < controlPointCount) {
+						weights.Add(cpIndex, boneIdx, (float)weight);
 					}
 				}
 			}
 		}
+
+		// Bring every control point's weights to the game's precision, and report anything that had to be fixed.
+		TTWeightAccumulator::Report report;
+		weights.Normalize(report, polyStart.data());
+
+		if (report.Unweighted > 0) {
+			job->Log.push_back({ TTLogEntry::eWarning, "Mesh: " + meshName + " - " + std::to_string(report.Unweighted) + " control points have no bone weights." });
+		}
+		if (report.Truncated > 0) {
+			job->Log.push_back({ TTLogEntry::eWarning, "Mesh: " + meshName + " - " + std::to_string(report.Truncated) + " control points had more than " + std::to_string(options.MaxWeights) + " bone weights.  Only the heaviest were kept." });
+		}
+		if (report.Renormalized > 0) {
+			job->Log.push_back({ TTLogEntry::eWarning, "Mesh: " + meshName + " - " + std::to_string(report.Renormalized) + " control points had bone weights that did not add up to 1 (lowest " + std::to_string(report.MinSum) + ", highest " + std::to_string(report.MaxSum) + ").  They have been normalized." });
+		}
 	}
 
 	FbxBlendShape* morpher = GetMorpher(mesh);
 
 
 	int deformerCount = mesh->GetDeformerCount();
-	std::vector<TTShapePart*> ShapeParts;
+	std::vector<TTShapePart*>& ShapeParts = job->Shapes;
 
 	auto vertexCount = mesh->GetControlPointsCount();
 	auto meshVerts = mesh->GetControlPoints();
@@ -750,8 +1148,8 @@ void FBXImporter::SaveNode(FbxNode* node) {
 
 	bool anyActiveBlends = false;
 
-	auto worldTransform = node->EvaluateGlobalTransform();
-	auto normalMatri = node->EvaluateGlobalTransform().Inverse().Transpose();
+	TTVertexTransform worldTransform(job->WorldTransform);
+	TTVertexTransform normalTransform(job->NormalMatrix);
 
 	// Loop Deformation Blends first.
 	for (int i = 0; i < deformerCount; i++) {
@@ -774,7 +1172,7 @@ void FBXImporter::SaveNode(FbxNode* node) {
 						continue;
 					}
 					else if(shapeCount > 1) {
-						fprintf(stderr, "%s contains invalid shape channel.  Channel will be ignored.\n", meshName.c_str());
+						job->Log.push_back({ TTLogEntry::eError, meshName + " contains invalid shape channel.  Channel will be ignored.\n" });
 						continue;
 					}
 
@@ -790,7 +1188,7 @@ void FBXImporter::SaveNode(FbxNode* node) {
 						if (pct == 0.0) {
 							continue;
 						}
-						fprintf(stdout, "Applying blend shape %s to mesh %s...\n", name.c_str(), meshName.c_str());
+						job->Log.push_back({ TTLogEntry::eInfo, "Applying blend shape " + name + " to mesh " + meshName + "...\n" });
 
 						anyActiveBlends = true;
 
@@ -846,7 +1244,7 @@ void FBXImporter::SaveNode(FbxNode* node) {
 						continue;
 					}
 					else if (shapeCount > 1) {
-						fprintf(stderr, "%s contains invalid shape channel.  Channel will be ignored.\n", meshName.c_str());
+						job->Log.push_back({ TTLogEntry::eError, meshName + " contains invalid shape channel.  Channel will be ignored.\n" });
 						continue;
 					}
 
@@ -864,7 +1262,7 @@ void FBXImporter::SaveNode(FbxNode* node) {
 
 						// Skip over duplicate shapes.
 						if (skip) {
-							fprintf(stderr, "%s has shape: %s included more than once.  Repeated shapes will be ignored.\n", meshName.c_str(), name.c_str());
+							job->Log.push_back({ TTLogEntry::eError, meshName + " has shape: " + name + " included more than once.  Repeated shapes will be ignored.\n" });
 							continue;
 						}
 
@@ -875,6 +1273,8 @@ void FBXImporter::SaveNode(FbxNode* node) {
 
 						// Any positions that aren't identical to the base mesh position
 						// needs to be added to the shapes listing.
+						std::vector<int> shapeIndices;
+						std::vector<FbxVector4> shapePositions;
 						for (int j = 0; j < vertexCount; j++)
 						{
 							auto shapeVert = fbxShape->GetControlPointAt(j);
@@ -884,13 +1284,16 @@ void FBXImporter::SaveNode(FbxNode* node) {
 								continue;
 							}
 							else {
-								TTVertex tVert;
-								auto worldPos = worldTransform.MultT(shapeVert);
-								tVert.Position = worldPos;
-								shape->VertexReplacements.insert({ j, tVert });
+								shapeIndices.push_back(j);
+								shapePositions.push_back(shapeVert);
 							}
 						}
 
+						worldTransform.Transform(shapePositions, false);
+						for (unsigned int j = 0; j < shapeIndices.size(); j++) {
+							shape->VertexReplacements.insert({ shapeIndices[j], shapePositions[j] });
+						}
+
 					}
 					else {
 						// No-Op. Handled Previously.
@@ -900,124 +1303,147 @@ void FBXImporter::SaveNode(FbxNode* node) {
 		}
 	}
 
-	std::vector<TTVertex> ttVertices;
-	std::vector<int> ttTriIndexes;
-	std::map<int, std::vector<int>> controlPointToVertexMapping;
+	delete[] vertArray;
+
+	job->Part = new TTPart();
+	job->Part->Name = meshName;
+	job->Part->PartId = job->PartNum;
+	job->Part->Node = node;
+
+	TTVertexBuffer& ttVertices = job->Part->Vertices;
+	std::vector<int>& ttTriIndexes = job->Part->Indices;
 	ttTriIndexes.resize(numIndices);
+	ttVertices.Reserve(numIndices);
+
+	// [control point index] => [vertex indexes made from it], in CSR form.
+	// Each control point's vertices are pushed together, so a start offset per control point is enough.
+	std::vector<int> vertexStart(controlPointCount + 1, 0);
+
 
+	// Pull every attribute for every triangle index out of the layers up front.
+	TTLayerPlan layerPlan;
+	TTMeshAttributes attributes;
+	MakeLayerPlan(mesh, layerPlan);
+	GatherAttributes(mesh, layerPlan, attributes);
+
+	// Bring everything into world space in one go.
+	worldTransform.Transform(attributes.Positions, false);
+	normalTransform.Transform(attributes.Normals, true);
+	worldTransform.Transform(attributes.Binormals, true);
+	worldTransform.Transform(attributes.Tangents, true);
+
+	// Scratch space for de-duplicating the vertices of each control point.
+	std::vector<TTVertexKey> sharedKeys;
+	std::vector<int> dedupTable;
 
 	// Time to convert all the data to TTVertices.
 	// Start by looping over the groups of shared vertices.
-	unsigned int vertCount = controlToPolyArray.size();
-	for (unsigned int cpi = 0; cpi < vertCount; cpi++) {
-		unsigned int sharedIndexCount = controlToPolyArray[cpi].size();
-		unsigned int oldSize = ttVertices.size();
+	for (int cpi = 0; cpi < controlPointCount; cpi++) {
+		unsigned int sharedIndexCount = polyStart[cpi + 1] - polyStart[cpi];
+		unsigned int oldSize = ttVertices.Size();
+		vertexStart[cpi] = oldSize;
 
 		// No indices, this is an orphaned control point, skip it.
 		if (sharedIndexCount == 0) continue;
 
-		// Setup vertex list
-		std::vector<TTVertex> sharedVerts;
-
+		// Setup the hash table used to find identical vertices.
+		// Open addressing, holding indices into sharedKeys, which line up with this control point's vertices.
+		sharedKeys.clear();
+		unsigned int tableSize = 1;
+		while (tableSize < sharedIndexCount * 2) {
+			tableSize <<= 1;
+		}
+		unsigned int tableMask = tableSize - 1;
+		dedupTable.assign(tableSize, -1);
 
 		// Loop all tri indices in that point to that control point.
 		for (unsigned ti = 0; ti < sharedIndexCount; ti++) {
 
-			int indexId = controlToPolyArray[cpi][ti];
-
-			// Build our own vertex.
-			TTVertex myVert;
-			int controlPointIndex = mesh->GetPolygonVertex(indexId / 3, indexId % 3);
-			auto vertWorldPosition = worldTransform.MultT(GetPosition(mesh, indexId));
-
-			
-			auto vertWorldNormal = normalMatri.MultT(GetNormal(mesh, indexId));
-			auto bin = GetBinormal(mesh, indexId);
-			auto tan = GetTangent(mesh, indexId);
-			auto vertWorldBinormal = worldTransform.MultT(bin);
-			auto vertWorldTangent = worldTransform.MultT(tan);
-
-			//auto localNormal = GetNormal(mesh, indexId);
-
-			vertWorldNormal.Normalize();
-			vertWorldBinormal.Normalize();
-			vertWorldTangent.Normalize();
-
-			myVert.Position = vertWorldPosition;
-			myVert.Normal = vertWorldNormal;
-			myVert.Binormal = vertWorldBinormal;
-			myVert.Tangent = vertWorldTangent;
-			myVert.VertexColor = GetVertexColor(mesh, indexId);
-			myVert.VertexColor2 = GetVertexColor2(mesh, indexId);
-			myVert.VertexColor3 = GetVertexColor3(mesh, indexId);
-			myVert.UV1 = GetUV1(mesh, indexId);
-			myVert.UV2 = GetUV2(mesh, indexId);
-			myVert.UV3 = GetUV3(mesh, indexId);
-			myVert.WeightSet = weightSets[controlPointIndex];
-
-			myVert.UV1Index = GetUV1Index(mesh, indexId);
-			myVert.UV2Index= GetUV2Index(mesh, indexId);
-			myVert.UV3Index = GetUV3Index(mesh, indexId);
-
-			// Loop through the shared vertices to see if we already have an identical entry.
+			int indexId = polyIndices[polyStart[cpi] + ti];
+
+			// Build our own vertex on the end of the buffer.  It's dropped again if it turns out to be a duplicate.
+			int myVert = ttVertices.Size();
+			int controlPointIndex = polygonVertices[indexId];
+			ttVertices.Resize(myVert + 1);
+			ttVertices.SetPosition(myVert, attributes.Positions[indexId]);
+			ttVertices.SetNormal(myVert, attributes.Normals[indexId]);
+			ttVertices.SetBinormal(myVert, attributes.Binormals[indexId]);
+			ttVertices.SetTangent(myVert, attributes.Tangents[indexId]);
+			ttVertices.SetColor(0, myVert, attributes.Colors[0][indexId]);
+			ttVertices.SetColor(1, myVert, attributes.Colors[1][indexId]);
+			ttVertices.SetFlowColor(myVert, attributes.Colors[2][indexId]);
+			ttVertices.SetUV(0, myVert, attributes.UVs[0][indexId]);
+			ttVertices.SetUV(1, myVert, attributes.UVs[1][indexId]);
+			ttVertices.SetUV(2, myVert, attributes.UVs[2][indexId]);
+			weights.CopyTo(controlPointIndex, ttVertices, myVert);
+
+			int uvIndices[3] = {
+				attributes.UVIndices[0][indexId],
+				attributes.UVIndices[1][indexId],
+				attributes.UVIndices[2][indexId]
+			};
+
+			// Check the hash table to see if we already have an identical entry.
+			TTVertexKey key(ttVertices, myVert, uvIndices);
 			int sharedVertToUse = -1;
-			for (unsigned int svi = 0; svi < sharedVerts.size(); svi++) {
-				TTVertex other = sharedVerts[svi];
-				if (myVert == other) {
-					sharedVertToUse = svi;
-					break;
+			unsigned int slot = (unsigned int)key.Hash & tableMask;
+			if (!key.Unique) {
+				while (dedupTable[slot] != -1) {
+					if (sharedKeys[dedupTable[slot]] == key) {
+						sharedVertToUse = dedupTable[slot];
+						break;
+					}
+					slot = (slot + 1) & tableMask;
 				}
 			}
 
 			// We are a unique vertex.
 			if (sharedVertToUse == -1)
 			{
-				sharedVerts.push_back(myVert);
-				sharedVertToUse = sharedVerts.size() - 1;
+				sharedKeys.push_back(key);
+				sharedVertToUse = sharedKeys.size() - 1;
+				if (!key.Unique) {
+					dedupTable[slot] = sharedVertToUse;
+				}
+			}
+			else {
+				ttVertices.Resize(myVert);
 			}
 
 			// Assign the triangle index the correct new tt_vertex index to use.
 			ttTriIndexes[indexId] = sharedVertToUse + oldSize;
 
 		}
-
-		// Push all our new vertices into the main list.
-		ttVertices.resize(oldSize + sharedVerts.size());
-		controlPointToVertexMapping.insert({ cpi , std::vector<int>() });
-		for (unsigned int svi = 0; svi < sharedVerts.size(); svi++) {
-			ttVertices[oldSize + svi] = sharedVerts[svi];
-			controlPointToVertexMapping[cpi].push_back(oldSize + svi);
-		}
 	}
+	vertexStart[controlPointCount] = ttVertices.Size();
 
 
-	// Now we need to go through our Shapes and convert them from control point index to TTVertex Index
+	// Now we need to go through our Shapes and convert them from control point index to vertex index
 	for (int sIdx = 0; sIdx < ShapeParts.size(); sIdx++) {
 		auto shape = ShapeParts[sIdx];
-		std::map<int, TTVertex> newMapping;
+		std::map<int, FbxVector4> newMapping;
 		for (auto it = shape->VertexReplacements.begin(); it != shape->VertexReplacements.end(); ++it) {
 
 			auto cpi = it->first;
-			auto arr = controlPointToVertexMapping[cpi];
-			for (int i = 0; i < arr.size(); i++) {
-				newMapping.insert({ arr[i], it->second });
+			if (cpi < 0 || cpi >= controlPointCount) continue;
+			for (int i = vertexStart[cpi]; i < vertexStart[cpi + 1]; i++) {
+				newMapping.insert({ i, it->second });
 			}
 		}
 		shape->VertexReplacements = newMapping;
 	}
 
-	// We now have a fully populated TT Vertex list
+	// We now have a fully populated TT vertex buffer
 	// And a fully populated triangle Index list that references it.
+}
 
+// Writes a part's indices and vertices to the DB, one row per index and vertex.
+void FBXImporter::WriteRows(int meshNum, int partNum, TTVertexBuffer& ttVertices, std::vector<int>& ttTriIndexes) {
 
 	// Start by writing the tri indexes.
-	const std::string startTransaction = "BEGIN TRANSACTION;";
-	const std::string endTransaction = "COMMIT;";
-
 	// Load the triangle indicies into the SQLite DB.
 	std::string insertStatement = "insert into indices (mesh, part, index_id, vertex_id) values (?1,?2,?3,?4)";
-	RunSql(startTransaction);
-	sqlite3_stmt* query = MakeSqlStatement(insertStatement);
+	sqlite3_stmt* query = GetStatement(insertStatement);
 	for (unsigned int i = 0; i < ttTriIndexes.size(); i++) {
 		sqlite3_bind_int(query, 1, meshNum);
 		sqlite3_bind_int(query, 2, partNum);
@@ -1025,134 +1451,499 @@ void FBXImporter::SaveNode(FbxNode* node) {
 		sqlite3_bind_int(query, 4, ttTriIndexes[i]);
 		RunSql(query);
 	}
-	sqlite3_finalize(query);
 
 	// Load the Vertices into the SQLite DB.
-	insertStatement = "insert into vertices (mesh, part, vertex_id, position_x, position_y, position_z, normal_x, normal_y, normal_z, color_r, color_g, color_b, color_a, color2_r, color2_g, color2_b, color2_a, uv_1_u, uv_1_v, uv_2_u, uv_2_v, bone_1_id, bone_1_weight, bone_2_id, bone_2_weight, bone_3_id, bone_3_weight, bone_4_id, bone_4_weight, bone_5_id, bone_5_weight, bone_6_id, bone_6_weight, bone_7_id, bone_7_weight, bone_8_id, bone_8_weight, binormal_x, binormal_y, binormal_z, tangent_x, tangent_y, tangent_z, uv_3_u, uv_3_v, flow_u, flow_v)";
+	insertStatement = "insert into vertices (" + std::string(vertexColumns) + ")";
 	insertStatement += "			 values(   ?1,   ?2,        ?3,         ?4,         ?5,         ?6,       ?7,       ?8,       ?9,     ?10,     ?11,     ?12,     ?13,      ?14,      ?15,      ?16,      ?17,    ?18,    ?19,    ?20,    ?21,       ?22,           ?23,       ?24,           ?25,       ?26,           ?27,       ?28,           ?29,       ?30,           ?31,       ?32,           ?33,       ?34,           ?35,       ?36,           ?37,        $38,        $39,        $40,       $41,       $42,       $43,    $44,    $45,    $46,    $47)";
-	query = MakeSqlStatement(insertStatement);
-	for (unsigned int i = 0; i < ttVertices.size(); i++) {
+	query = GetStatement(insertStatement);
+	for (int i = 0; i < ttVertices.Size(); i++) {
+		const float* position = &ttVertices.Positions[i * 3];
+		const float* normal = &ttVertices.Normals[i * 3];
+		const float* binormal = &ttVertices.Binormals[i * 3];
+		const float* tangent = &ttVertices.Tangents[i * 3];
+		const uint8_t* color = &ttVertices.Colors[0][i * 4];
+		const uint8_t* color2 = &ttVertices.Colors[1][i * 4];
+		const float* uv1 = &ttVertices.UVs[0][i * 2];
+		const float* uv2 = &ttVertices.UVs[1][i * 2];
+		const float* uv3 = &ttVertices.UVs[2][i * 2];
+		const float* flow = &ttVertices.Flow[i * 2];
+
 		sqlite3_bind_int(query, 1, meshNum);
 		sqlite3_bind_int(query, 2, partNum);
 		sqlite3_bind_int(query, 3, i);
 
-		sqlite3_bind_double(query, 4, ttVertices[i].Position[0]);
-		sqlite3_bind_double(query, 5, ttVertices[i].Position[1]);
-		sqlite3_bind_double(query, 6, ttVertices[i].Position[2]);
+		for (int c = 0; c < 3; c++) sqlite3_bind_double(query, 4 + c, position[c]);
+		for (int c = 0; c < 3; c++) sqlite3_bind_double(query, 7 + c, normal[c]);
+		for (int c = 0; c < 4; c++) sqlite3_bind_double(query, 10 + c, color[c] / 255.0);
+		for (int c = 0; c < 4; c++) sqlite3_bind_double(query, 14 + c, color2[c] / 255.0);
+		for (int c = 0; c < 2; c++) sqlite3_bind_double(query, 18 + c, uv1[c]);
+		for (int c = 0; c < 2; c++) sqlite3_bind_double(query, 20 + c, uv2[c]);
+
+		// Unused weight slots are left NULL.
+		for (int wi = 0; wi < _TTW_Max_Weights; wi++) {
+			int boneId = ttVertices.GetBoneId(i, wi);
+			if (boneId >= 0) {
+				sqlite3_bind_int(query, 22 + wi * 2, boneId);
+				sqlite3_bind_double(query, 23 + wi * 2, ttVertices.GetWeight(i, wi));
+			}
+		}
 
-		sqlite3_bind_double(query, 7, ttVertices[i].Normal[0]);
-		sqlite3_bind_double(query, 8, ttVertices[i].Normal[1]);
-		sqlite3_bind_double(query, 9, ttVertices[i].Normal[2]);
+		for (int c = 0; c < 3; c++) sqlite3_bind_double(query, 38 + c, binormal[c]);
+		for (int c = 0; c < 3; c++) sqlite3_bind_double(query, 41 + c, tangent[c]);
+		for (int c = 0; c < 2; c++) sqlite3_bind_double(query, 44 + c, uv3[c]);
+		for (int c = 0; c < 2; c++) sqlite3_bind_double(query, 46 + c, flow[c]);
 
-		sqlite3_bind_double(query, 10, ttVertices[i].VertexColor.mRed);
-		sqlite3_bind_double(query, 11, ttVertices[i].VertexColor.mGreen);
-		sqlite3_bind_double(query, 12, ttVertices[i].VertexColor.mBlue);
-		sqlite3_bind_double(query, 13, ttVertices[i].VertexColor.mAlpha);
+		RunSql(query);
+	}
+}
 
-		sqlite3_bind_double(query, 14, ttVertices[i].VertexColor2.mRed);
-		sqlite3_bind_double(query, 15, ttVertices[i].VertexColor2.mGreen);
-		sqlite3_bind_double(query, 16, ttVertices[i].VertexColor2.mBlue);
-		sqlite3_bind_double(query, 17, ttVertices[i].VertexColor2.mAlpha);
+// Writes a part's indices and vertices to the DB, one row per stream.
+void FBXImporter::WriteStreams(int meshNum, int partNum, TTVertexBuffer& ttVertices, std::vector<int>& ttTriIndexes) {
+	std::vector<unsigned char> streams[eStreamCount];
+	PackStreams(ttVertices, ttTriIndexes, streams);
 
-		sqlite3_bind_double(query, 18, ttVertices[i].UV1[0]);
-		sqlite3_bind_double(query, 19, ttVertices[i].UV1[1]);
+	std::string insertStatement = "insert into streams (mesh, part, stream, count, data) values (?1,?2,?3,?4,?5)";
+	sqlite3_stmt* query = GetStatement(insertStatement);
+	for (int s = 0; s < eStreamCount; s++) {
+		int count = s == eStreamIndices ? ttTriIndexes.size() : ttVertices.Size();
+		sqlite3_bind_int(query, 1, meshNum);
+		sqlite3_bind_int(query, 2, partNum);
+		sqlite3_bind_text(query, 3, _TT_Stream_Layouts[s].Name, -1, NULL);
+		sqlite3_bind_int(query, 4, count);
+		sqlite3_bind_blob(query, 5, streams[s].data(), streams[s].size(), NULL);
+		RunSql(query);
+	}
+}
 
-		sqlite3_bind_double(query, 20, ttVertices[i].UV2[0]);
-		sqlite3_bind_double(query, 21, ttVertices[i].UV2[1]);
+// Hands a node's extracted data over to the model's part, in place of writing it to the DB.
+void FBXImporter::SaveToModel(TTNodeJob* job) {
+	TTPart* part = model->GetPart(job->MeshNum, job->PartNum);
+	part->Vertices = std::move(job->Part->Vertices);
+	part->Indices = std::move(job->Part->Indices);
 
-		if (ttVertices[i].WeightSet.Weights[0].BoneId >= 0) {
-			sqlite3_bind_int(query, 22, ttVertices[i].WeightSet.Weights[0].BoneId);
-			sqlite3_bind_double(query, 23, ttVertices[i].WeightSet.Weights[0].Weight);
-		}
+	for (unsigned int i = 0; i < job->Shapes.size(); i++) {
+		TTShapePart*& shape = part->Shapes[job->Shapes[i]->Name];
+		delete shape;
+		shape = job->Shapes[i];
+	}
+	job->Shapes.clear();
+}
 
-		if (ttVertices[i].WeightSet.Weights[1].BoneId >= 0) {
-			sqlite3_bind_int(query, 24, ttVertices[i].WeightSet.Weights[1].BoneId);
-			sqlite3_bind_double(query, 25, ttVertices[i].WeightSet.Weights[1].Weight);
+/**
+ * Maps the bone Ids a reused part has in the previous DB to this import's Ids for the
+ * same bones, adding any the mesh doesn't have yet in the order they were numbered before.
+ * Returns false if the previous DB doesn't hold the part's bones, in which case nothing is added.
+ */
+bool FBXImporter::MapPreviousBones(TTNodeJob* job, std::map<int, int>& boneMap) {
+	std::set<int> used;
+	sqlite3_stmt* query;
+	bool found = false;
+
+	if (options.ColumnarDb) {
+		query = GetStatement("select data from prev.streams where mesh = ?1 and part = ?2 and stream = 'bone_ids'");
+		sqlite3_bind_int(query, 1, job->MeshNum);
+		sqlite3_bind_int(query, 2, job->PartNum);
+		if (sqlite3_step(query) == SQLITE_ROW) {
+			found = true;
+			const unsigned char* in = (const unsigned char*)sqlite3_column_blob(query, 0);
+			int count = sqlite3_column_bytes(query, 0) / 4;
+			for (int i = 0; i < count; i++) {
+				int id = GetStreamInt(in);
+				if (id >= 0) {
+					used.insert(id);
+				}
+			}
+		}
+	}
+	else {
+		// The part's own row comes back as well, so a part missing from the previous DB
+		// isn't mistaken for one without bones.
+		std::string select = "select 0, count(*) from prev.parts where mesh = ?1 and part = ?2";
+		for (int wi = 1; wi <= _TTW_Max_Weights; wi++) {
+			std::string column = "bone_" + std::to_string(wi) + "_id";
+			select += " union select 1, " + column + " from prev.vertices where mesh = ?1 and part = ?2 and " + column + " is not null";
 		}
 
-		if (ttVertices[i].WeightSet.Weights[2].BoneId >= 0) {
-			sqlite3_bind_int(query, 26, ttVertices[i].WeightSet.Weights[2].BoneId);
-			sqlite3_bind_double(query, 27, ttVertices[i].WeightSet.Weights[2].Weight);
+		query = GetStatement(select);
+		sqlite3_bind_int(query, 1, job->MeshNum);
+		sqlite3_bind_int(query, 2, job->PartNum);
+		while (sqlite3_step(query) == SQLITE_ROW) {
+			if (sqlite3_column_int(query, 0) == 0) {
+				found = sqlite3_column_int(query, 1) > 0;
+			}
+			else {
+				used.insert(sqlite3_column_int(query, 1));
+			}
 		}
+	}
+	sqlite3_reset(query);
+	sqlite3_clear_bindings(query);
+
+	if (!found) {
+		return false;
+	}
 
-		if (ttVertices[i].WeightSet.Weights[3].BoneId >= 0) {
-			sqlite3_bind_int(query, 28, ttVertices[i].WeightSet.Weights[3].BoneId);
-			sqlite3_bind_double(query, 29, ttVertices[i].WeightSet.Weights[3].Weight);
+	std::vector<std::string> names;
+	query = GetStatement("select name from prev.bones where mesh = ?1 and bone_id = ?2");
+	for (auto it = used.begin(); it != used.end(); ++it) {
+		sqlite3_bind_int(query, 1, job->MeshNum);
+		sqlite3_bind_int(query, 2, *it);
+		if (sqlite3_step(query) == SQLITE_ROW) {
+			names.push_back((const char*)sqlite3_column_text(query, 0));
 		}
+		sqlite3_reset(query);
+		sqlite3_clear_bindings(query);
+	}
+	if (names.size() != used.size()) {
+		return false;
+	}
 
-		if (ttVertices[i].WeightSet.Weights[4].BoneId >= 0) {
-			sqlite3_bind_int(query, 30, ttVertices[i].WeightSet.Weights[4].BoneId);
-			sqlite3_bind_double(query, 31, ttVertices[i].WeightSet.Weights[4].Weight);
+	int ni = 0;
+	for (auto it = used.begin(); it != used.end(); ++it, ni++) {
+		int name;
+		{
+			std::lock_guard<std::mutex> lock(nameMutex);
+			name = boneNameTable.Intern(names[ni].c_str());
 		}
+		boneMap[*it] = GetBoneId(job->MeshNum, name);
+	}
+	return true;
+}
+
+/**
+ * Copies a reused part's indices, vertices and shapes over from the previous DB,
+ * with its bone Ids mapped to this import's.
+ */
+void FBXImporter::CopyPreviousPart(TTNodeJob* job, const std::map<int, int>& boneMap) {
+	int meshNum = job->MeshNum;
+	int partNum = job->PartNum;
+	sqlite3_stmt* query;
+
+	if (options.ColumnarDb) {
+		query = GetStatement("insert into streams (mesh, part, stream, count, data) select mesh, part, stream, count, data from prev.streams where mesh = ?1 and part = ?2 and stream != 'bone_ids'");
+		sqlite3_bind_int(query, 1, meshNum);
+		sqlite3_bind_int(query, 2, partNum);
+		RunSql(query);
 
-		if (ttVertices[i].WeightSet.Weights[5].BoneId >= 0) {
-			sqlite3_bind_int(query, 32, ttVertices[i].WeightSet.Weights[5].BoneId);
-			sqlite3_bind_double(query, 33, ttVertices[i].WeightSet.Weights[5].Weight);
+		// Bone ids are rewritten one by one.  -1 marks an empty slot, and stays as is.
+		int count = 0;
+		std::vector<unsigned char> boneIds;
+		query = GetStatement("select count, data from prev.streams where mesh = ?1 and part = ?2 and stream = 'bone_ids'");
+		sqlite3_bind_int(query, 1, meshNum);
+		sqlite3_bind_int(query, 2, partNum);
+		if (sqlite3_step(query) == SQLITE_ROW) {
+			count = sqlite3_column_int(query, 0);
+			const unsigned char* data = (const unsigned char*)sqlite3_column_blob(query, 1);
+			boneIds.assign(data, data + sqlite3_column_bytes(query, 1));
 		}
+		sqlite3_reset(query);
+		sqlite3_clear_bindings(query);
+
+		const unsigned char* in = boneIds.data();
+		unsigned char* out = boneIds.data();
+		for (unsigned int i = 0; i < boneIds.size() / 4; i++) {
+			int id = GetStreamInt(in);
+			auto it = boneMap.find(id);
+			PutStreamInt(out, it != boneMap.end() ? it->second : id);
+		}
+
+		query = GetStatement("insert into streams (mesh, part, stream, count, data) values (?1,?2,?3,?4,?5)");
+		sqlite3_bind_int(query, 1, meshNum);
+		sqlite3_bind_int(query, 2, partNum);
+		sqlite3_bind_text(query, 3, _TT_Stream_Layouts[eStreamBoneIds].Name, -1, NULL);
+		sqlite3_bind_int(query, 4, count);
+		sqlite3_bind_blob(query, 5, boneIds.data(), boneIds.size(), NULL);
+		RunSql(query);
+	}
+	else {
+		query = GetStatement("insert into indices (mesh, part, index_id, vertex_id) select mesh, part, index_id, vertex_id from prev.indices where mesh = ?1 and part = ?2");
+		sqlite3_bind_int(query, 1, meshNum);
+		sqlite3_bind_int(query, 2, partNum);
+		RunSql(query);
 
-		if (ttVertices[i].WeightSet.Weights[6].BoneId >= 0) {
-			sqlite3_bind_int(query, 34, ttVertices[i].WeightSet.Weights[6].BoneId);
-			sqlite3_bind_double(query, 35, ttVertices[i].WeightSet.Weights[6].Weight);
+		// Vertices are copied as is, other than their bone ids, which go through the map.
+		RunSql("create temp table if not exists bone_map (old_id integer primary key, new_id integer not null)");
+		RunSql("delete from temp.bone_map");
+		query = GetStatement("insert into temp.bone_map (old_id, new_id) values (?1, ?2)");
+		for (auto it = boneMap.begin(); it != boneMap.end(); ++it) {
+			sqlite3_bind_int(query, 1, it->first);
+			sqlite3_bind_int(query, 2, it->second);
+			RunSql(query);
 		}
 
-		if (ttVertices[i].WeightSet.Weights[7].BoneId >= 0) {
-			sqlite3_bind_int(query, 36, ttVertices[i].WeightSet.Weights[7].BoneId);
-			sqlite3_bind_double(query, 37, ttVertices[i].WeightSet.Weights[7].Weight);
+		static const std::string select = std::regex_replace(vertexColumns, std::regex("bone_([0-9])_id"), "(select new_id from temp.bone_map where old_id = bone_$1_id)");
+		query = GetStatement("insert into vertices (" + std::string(vertexColumns) + ") select " + select + " from prev.vertices where mesh = ?1 and part = ?2");
+		sqlite3_bind_int(query, 1, meshNum);
+		sqlite3_bind_int(query, 2, partNum);
+		RunSql(query);
+	}
+
+	query = GetStatement("insert into shape_vertices (shape, mesh, part, vertex_id, position_x, position_y, position_z) select shape, mesh, part, vertex_id, position_x, position_y, position_z from prev.shape_vertices where mesh = ?1 and part = ?2");
+	sqlite3_bind_int(query, 1, meshNum);
+	sqlite3_bind_int(query, 2, partNum);
+	RunSql(query);
+}
+
+/**
+ * Saves the given node's extracted data to the SQLite DB.
+ * Nodes are always saved one at a time, in scene order.
+ */
+void FBXImporter::SaveNode(TTNodeJob* job) {
+
+	// A reused part's bones are mapped before anything is written.  If the previous
+	// DB turns out not to have them, the part is extracted after all.
+	std::map<int, int> boneMap;
+	if (job->Reused && !MapPreviousBones(job, boneMap)) {
+		job->Reused = false;
+		ExtractNode(job);
+	}
+
+	// Replay anything logged while the node was queued and extracted.
+	for (unsigned int i = 0; i < job->Log.size(); i++) {
+		TTLogEntry& entry = job->Log[i];
+		if (entry.Type == TTLogEntry::eWarning) {
+			WriteWarning(entry.Text);
 		}
+		else if (entry.Type == TTLogEntry::eError) {
+			fputs(entry.Text.c_str(), stderr);
+		}
+		else {
+			fputs(entry.Text.c_str(), stdout);
+		}
+	}
 
-		sqlite3_bind_double(query, 38, ttVertices[i].Binormal[0]);
-		sqlite3_bind_double(query, 39, ttVertices[i].Binormal[1]);
-		sqlite3_bind_double(query, 40, ttVertices[i].Binormal[2]);
+	if (job->Skip) {
+		return;
+	}
 
-		sqlite3_bind_double(query, 41, ttVertices[i].Tangent[0]);
-		sqlite3_bind_double(query, 42, ttVertices[i].Tangent[1]);
-		sqlite3_bind_double(query, 43, ttVertices[i].Tangent[2]);
+	int meshNum = job->MeshNum;
+	int partNum = job->PartNum;
 
-		sqlite3_bind_double(query, 44, ttVertices[i].UV3[0]);
-		sqlite3_bind_double(query, 45, ttVertices[i].UV3[1]);
+	// Add the mesh part.
+	WriteMeshPart(meshNum, partNum, job->MeshName, job->ParentName, job->NewMeshGroup);
 
-		sqlite3_bind_double(query, 46, (ttVertices[i].VertexColor3[0] * 2) - 1.0f);
-		sqlite3_bind_double(query, 47, (ttVertices[i].VertexColor3[1] *2) - 1.0f);
+	// Critical errors are handled by the caller once the other workers are stopped.
+	if (job->ErrorCode != 0) {
+		return;
+	}
 
+	// Record what the part was made from, for the next incremental import.
+	if (job->Fingerprint != 0) {
+		char value[17];
+		snprintf(value, sizeof(value), "%016llx", (unsigned long long)job->Fingerprint);
+		std::string key = "fingerprint_" + std::to_string(meshNum) + "_" + std::to_string(partNum);
+		sqlite3_stmt* query = GetStatement("insert into meta (key, value) values (?1, ?2)");
+		sqlite3_bind_text(query, 1, key.c_str(), key.length(), NULL);
+		sqlite3_bind_text(query, 2, value, -1, NULL);
 		RunSql(query);
 	}
-	sqlite3_finalize(query);
+
+	if (job->Reused) {
+		fprintf(stdout, "Mesh: %s - Unchanged since the last import, copying it over.\n", job->MeshName.c_str());
+		CopyPreviousPart(job, boneMap);
+		return;
+	}
+
+	TTVertexBuffer& ttVertices = job->Part->Vertices;
+	std::vector<int>& ttTriIndexes = job->Part->Indices;
+	std::vector<TTShapePart*>& ShapeParts = job->Shapes;
+
+	// Bone Ids are shared by every part in the mesh, so they can only be assigned
+	// now that the earlier parts have been saved.
+	std::vector<int> boneIds(job->BoneNames.size());
+	for (unsigned int bi = 0; bi < job->BoneNames.size(); bi++) {
+		boneIds[bi] = GetBoneId(meshNum, job->BoneNames[bi]);
+	}
+	for (unsigned int i = 0; i < ttVertices.BoneIds.size(); i++) {
+		uint16_t localId = ttVertices.BoneIds[i];
+		if (localId != _TTW_No_Bone) {
+			ttVertices.BoneIds[i] = (uint16_t)boneIds[localId];
+		}
+	}
+
+	if (model != NULL) {
+		SaveToModel(job);
+		return;
+	}
+
+	if (options.ColumnarDb) {
+		WriteStreams(meshNum, partNum, ttVertices, ttTriIndexes);
+	}
+	else {
+		WriteRows(meshNum, partNum, ttVertices, ttTriIndexes);
+	}
 
 	// Load Shape Vertices into SQLite DB.
-	insertStatement = "insert into shape_vertices (shape, mesh, part, vertex_id, position_x, position_y, position_z)";
+	std::string insertStatement = "insert into shape_vertices (shape, mesh, part, vertex_id, position_x, position_y, position_z)";
 	insertStatement += "			        values(   ?1,   ?2,   ?3,        ?4,         ?5,         ?6,		 ?7)";
-	query = MakeSqlStatement(insertStatement);
+	sqlite3_stmt* query = GetStatement(insertStatement);
 	for (unsigned int i = 0; i < ShapeParts.size(); i++) {
 		auto shape = ShapeParts[i];
 
 		for (auto it = shape->VertexReplacements.begin(); it != shape->VertexReplacements.end(); ++it) {
 			auto vertexId = it->first;
-			auto vertex = it->second;
+			auto& position = it->second;
 
 			sqlite3_bind_text(query, 1, shape->Name.c_str(), shape->Name.length(), NULL);
 			sqlite3_bind_int(query, 2, meshNum);
 			sqlite3_bind_int(query, 3, partNum);
 			sqlite3_bind_int(query, 4, vertexId);
 
-			sqlite3_bind_double(query, 5, vertex.Position[0]);
-			sqlite3_bind_double(query, 6, vertex.Position[1]);
-			sqlite3_bind_double(query, 7, vertex.Position[2]);
+			sqlite3_bind_double(query, 5, position[0]);
+			sqlite3_bind_double(query, 6, position[1]);
+			sqlite3_bind_double(query, 7, position[2]);
 
 			RunSql(query);
 
 		}
 
 	}
-	sqlite3_finalize(query);
 
 
-	RunSql(endTransaction);
+}
 
+/**
+ * Extracts and saves all of the queued nodes.
+ * With more than one thread, extraction is spread over a pool of workers, while
+ * a single writer thread owns the DB and saves each node in scene order as soon
+ * as it is ready, so the resulting DB is identical to the serial one.
+ */
+void FBXImporter::RunJobs() {
+	int threadCount = options.Threads;
+	if (threadCount == 0) {
+		threadCount = std::thread::hardware_concurrency();
+	}
+	if (threadCount > (int)jobs.size()) {
+		threadCount = jobs.size();
+	}
+
+	// A critical error, either from a node or thrown while saving.
+	// It's only raised once every thread is done with the jobs.
+	int errorCode = 0;
+	std::string errorMessage;
+
+	if (threadCount <= 1) {
+		try {
+			for (unsigned int i = 0; i < jobs.size(); i++) {
+				ExtractNode(jobs[i]);
+				SaveNode(jobs[i]);
+				if (jobs[i]->ErrorCode != 0) {
+					errorCode = jobs[i]->ErrorCode;
+					errorMessage = jobs[i]->ErrorMessage;
+					break;
+				}
+				jobs[i]->Release();
+			}
+		}
+		catch (TTError& e) {
+			errorCode = e.Code;
+			errorMessage = e.what();
+		}
+		catch (std::exception& e) {
+			errorCode = _TT_Unhandled_Error;
+			errorMessage = e.what();
+		}
+		catch (...) {
+			errorCode = _TT_Unhandled_Error;
+			errorMessage = "Unknown error.";
+		}
+	}
+	else {
+		std::atomic<unsigned int> nextJob(0);
+		std::atomic<bool> abort(false);
+
+		auto worker = [this, &nextJob, &abort]() {
+			unsigned int i;
+			while (!abort && (i = nextJob++) < jobs.size()) {
+				TTNodeJob* job = jobs[i];
+
+				if (job->DependsOn >= 0) {
+					TTNodeJob* dependency = jobs[job->DependsOn];
+					std::unique_lock<std::mutex> lock(jobMutex);
+					jobDone.wait(lock, [dependency] { return dependency->Done; });
+				}
+
+				// Failures go to the writer on the job, as they can't be thrown across threads.
+				try {
+					ExtractNode(job);
+				}
+				catch (std::exception& e) {
+					job->ErrorCode = _TT_Unhandled_Error;
+					job->ErrorMessage = e.what();
+				}
+				catch (...) {
+					job->ErrorCode = _TT_Unhandled_Error;
+					job->ErrorMessage = "Unknown error.";
+				}
+
+				{
+					std::lock_guard<std::mutex> lock(jobMutex);
+					job->Done = true;
+				}
+				jobDone.notify_all();
+			}
+		};
+
+		auto writer = [this, &abort, &errorCode, &errorMessage]() {
+			try {
+				for (unsigned int i = 0; i < jobs.size(); i++) {
+					TTNodeJob* job = jobs[i];
+					{
+						std::unique_lock<std::mutex> lock(jobMutex);
+						jobDone.wait(lock, [job] { return job->Done; });
+					}
+
+					SaveNode(job);
+					if (job->ErrorCode != 0) {
+						errorCode = job->ErrorCode;
+						errorMessage = job->ErrorMessage;
+						abort = true;
+						return;
+					}
+					job->Release();
+				}
+			}
+			catch (TTError& e) {
+				errorCode = e.Code;
+				errorMessage = e.what();
+				abort = true;
+			}
+			catch (std::exception& e) {
+				errorCode = _TT_Unhandled_Error;
+				errorMessage = e.what();
+				abort = true;
+			}
+			catch (...) {
+				errorCode = _TT_Unhandled_Error;
+				errorMessage = "Unknown error.";
+				abort = true;
+			}
+		};
+
+		std::thread writerThread(writer);
+		std::vector<std::thread> workerThreads;
+		for (int i = 0; i < threadCount; i++) {
+			workerThreads.push_back(std::thread(worker));
+		}
+		for (unsigned int i = 0; i < workerThreads.size(); i++) {
+			workerThreads[i].join();
+		}
+		writerThread.join();
+	}
+
+	for (unsigned int i = 0; i < jobs.size(); i++) {
+		delete jobs[i];
+	}
+	jobs.clear();
+	meshJobs.clear();
 
+	if (errorCode != 0) {
+		throw TTError(errorCode, errorMessage);
+	}
 }
 
 /**
- * Recursively scans the node tree for nodes that match our Regex, then pipes them to the save function.
+ * Recursively scans the node tree for nodes that match our Regex, then queues them for import.
  */
 void FBXImporter::TestNode(FbxNode* pNode) {
 	const char* nodeName = pNode->GetName();
@@ -1164,8 +1955,8 @@ void FBXImporter::TestNode(FbxNode* pNode) {
 	bool show = pNode->Show.Get();
 	if (regex_match(nodeName, meshRegex) && pNode->GetMesh() != NULL && show) {
 
-		// Save the node to the db.
-		SaveNode(pNode);
+		// Queue the node for saving.
+		QueueNode(pNode);
 	}
 
 	// Continue scanning the tree.
@@ -1173,12 +1964,53 @@ void FBXImporter::TestNode(FbxNode* pNode) {
 		TestNode(pNode->GetChild(j));
 }
 
-int FBXImporter::ImportFBX(std::wstring fbxfilepath) {
+/**
+ * Imports the given FBX file into result.db, or the output path in the options.
+ * If a manager is supplied, it's used as is and left alive afterwards.
+ * Returns 0 on success, or the error code.
+ */
+int FBXImporter::ImportFBX(std::wstring fbxfilepath, TTOptions importOptions, FbxManager* sharedManager) {
+	options = importOptions;
+	dbPath = options.Output.empty() ? defaultDbPath : options.Output;
+
 	// Try to load all the things.
-	int result = Init(fbxfilepath, &db, &manager, &scene);
+	int result = Init(fbxfilepath, &db, &manager, &scene, sharedManager);
 	if (result != 0) {
 		return result;
 	}
+
+	try {
+		ImportScene();
+	}
+	catch (TTError& e) {
+		return Shutdown(e.Code, e.what());
+	}
+	catch (std::exception& e) {
+		return Shutdown(_TT_Unhandled_Error, e.what());
+	}
+	catch (...) {
+		return Shutdown(_TT_Unhandled_Error, "Unknown error.");
+	}
+
+	fprintf(stdout, "Successfully processed FBX File.\n");
+	// Successs~
+	return Shutdown(0);
+}
+
+/**
+ * Imports the given FBX file straight into a model, without going through a DB.
+ * If data is supplied, it's read as the FBX file's contents, and the path is only used for the log.
+ * Returns 0 on success, or the error code.
+ */
+int FBXImporter::ImportModel(TTModel* target, std::wstring fbxfilepath, const void* data, size_t size, TTOptions importOptions, FbxManager* sharedManager) {
+	model = target;
+	sourceData = data;
+	sourceSize = size;
+	return ImportFBX(fbxfilepath, importOptions, sharedManager);
+}
+
+// Finds, extracts and saves every mesh in the loaded scene, then the bone lists.
+void FBXImporter::ImportScene() {
 	// We're now ready to actually do some work.
 
 
@@ -1192,21 +2024,38 @@ int FBXImporter::ImportFBX(std::wstring fbxfilepath) {
 		}
 	}
 
+	// Announce the columnar layout before any vertex data goes in.
+	if (options.ColumnarDb && model == NULL) {
+		RunSql("insert into meta (key, value) values ('schema_version', '" + std::to_string(_TT_Streams_Schema_Version) + "')");
+	}
+
+	// Extract and save everything we found.
+	RunJobs();
+
+	if (model != NULL) {
+		for (unsigned int mi = 0; mi < meshBones.size(); mi++) {
+			TTMeshGroup* group = model->GetMeshGroup(mi);
+			group->Bones.resize(meshBones[mi].size());
+			for (unsigned int bi = 0; bi < meshBones[mi].size(); bi++) {
+				group->Bones[bi] = model->Names.Intern(boneNameTable.Get(meshBones[mi][bi]));
+			}
+		}
+		if (model->ModelNames.empty()) {
+			model->ModelNames.push_back(model->RootName);
+		}
+		return;
+	}
+
 	// Save bones to the SQLite DB
 	std::string insertStatement = "insert into bones (mesh, bone_id, name) values (?1,?2,?3)";
-	sqlite3_stmt* query = MakeSqlStatement(insertStatement);
-	for (unsigned int mi = 0; mi < boneNames.size(); mi++) {
-		for (unsigned int bi = 0; bi < boneNames[mi].size(); bi++) {
+	sqlite3_stmt* query = GetStatement(insertStatement);
+	for (unsigned int mi = 0; mi < meshBones.size(); mi++) {
+		for (unsigned int bi = 0; bi < meshBones[mi].size(); bi++) {
+			const std::string& name = boneNameTable.Get(meshBones[mi][bi]);
 			sqlite3_bind_int(query, 1, mi);
 			sqlite3_bind_int(query, 2, bi);
-			sqlite3_bind_text(query, 3, boneNames[mi][bi].c_str(), boneNames[mi][bi].length(), NULL);
+			sqlite3_bind_text(query, 3, name.c_str(), name.length(), NULL);
 			RunSql(query);
 		}
 	}
-	sqlite3_finalize(query);
-
-
-	fprintf(stdout, "Successfully processed FBX File.\n");
-	// Successs~
-	Shutdown(0);
 }
@@ -15,59 +15,225 @@
 #include <exception>
 #include <vector>
 #include <map>
+#include <set>
+#include <unordered_map>
 #include <regex>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <filesystem>
 #include "tchar.h"
 
 // Custom
 #include <tt_model.h>
+#include <tt_options.h>
+#include <tt_streams.h>
+#include <vertex_transform.h>
+#include <weight_accumulator.h>
+#include <tt_error.h>
+#include <fbx_memory_stream.h>
+#include <tt_hash.h>
+#include <tt_utf8.h>
 
-// Blegh.  Don't have another good way to convert wstring to utf8 for now.
-#include <windows.h>
+// Bump whenever a change alters what a part extracts to, so incremental imports
+// never reuse parts written by older builds.
+#define _TT_Fingerprint_Version 1
+
+// A message raised while processing a node.  These are held on the node's job
+// and replayed when the node is saved, so output order never depends on which
+// worker thread finished first.
+struct TTLogEntry {
+	enum EType {
+		eInfo,		// stdout
+		eError,		// stderr
+		eWarning	// stderr + warnings table
+	};
+
+	EType Type;
+	std::string Text;
+};
+
+// The layer elements a mesh's vertex attributes are read from, resolved once per mesh.
+// NULL elements fall back to the attribute's default value.
+class TTLayerPlan {
+public:
+	bool HasLayers = false;
+	FbxLayerElementNormal* Normals = NULL;
+	FbxLayerElementBinormal* Binormals = NULL;
+	FbxLayerElementTangent* Tangents = NULL;
+	FbxLayerElementUV* UVs[3] = { NULL, NULL, NULL };
+	FbxLayerElementVertexColor* Colors[3] = { NULL, NULL, NULL };
+};
+
+// Raw vertex attributes for every triangle index of a mesh.
+class TTMeshAttributes {
+public:
+	std::vector<FbxVector4> Positions;
+	std::vector<FbxVector4> Normals;
+	std::vector<FbxVector4> Binormals;
+	std::vector<FbxVector4> Tangents;
+	std::vector<FbxVector2> UVs[3];
+	std::vector<int> UVIndices[3];
+	std::vector<FbxColor> Colors[3];
+};
+
+// A mesh node queued for import.  The node is extracted into Part on a
+// worker thread, then handed to the writer which owns the DB connection.
+class TTNodeJob {
+public:
+	FbxNode* Node;
+	FbxMesh* Mesh;
+	std::string MeshName;
+
+	// Set when the node is rejected up front; only the log is written.
+	bool Skip = false;
+
+	// Index of an earlier job sharing the same FbxMesh, which must finish
+	// first since extraction bakes active blends into the control points.
+	int DependsOn = -1;
+
+	// Set when another node shares the same FbxMesh.  Such parts are never reused.
+	bool SharedMesh = false;
+
+	int MeshNum = 0;
+	int PartNum = 0;
+	std::string ParentName;
+	bool NewMeshGroup = false;
+
+	FbxAMatrix WorldTransform;
+	FbxAMatrix NormalMatrix;
+
+	// Hash of everything extraction reads for this part, stored in the DB so the
+	// next incremental import can tell whether it changed.  0 if not fingerprinted.
+	uint64_t Fingerprint = 0;
+
+	// Set when the part hasn't changed since the previous import.  Nothing is
+	// extracted, and the writer copies the part over from the previous DB instead.
+	bool Reused = false;
+
+	// Bone name ids in first-use order.  Weights in Part reference these
+	// local indices until the writer assigns the real per-mesh bone Ids.
+	std::vector<int> BoneNames;
+
+	TTPart* Part = NULL;
+	std::vector<TTShapePart*> Shapes;
+	std::vector<TTLogEntry> Log;
+
+	// Non-zero if extraction hit a critical error.
+	int ErrorCode = 0;
+	std::string ErrorMessage;
+
+	bool Done = false;
+
+	// Frees the extracted data once it has been saved.
+	void Release() {
+		delete Part;
+		Part = NULL;
+
+		for (unsigned int i = 0; i < Shapes.size(); i++) {
+			delete Shapes[i];
+		}
+		Shapes.clear();
+	}
+
+	~TTNodeJob() {
+		Release();
+	}
+};
 
 class FBXImporter {
-	sqlite3* db;
-	FbxManager* manager;
-	FbxScene* scene;
+	sqlite3* db = NULL;
+	FbxManager* manager = NULL;
+	FbxScene* scene = NULL;
+
+	// False when the manager was handed to us, and outlives this import.
+	bool ownsManager = true;
+
+	TTOptions options;
 
-	std::vector<std::vector<std::string>> boneNames;
+	// The DB file being written.
+	std::wstring dbPath;
+
+	// Set when importing straight into a model, in which case no DB is made at all.
+	TTModel* model = NULL;
+
+	// FBX file contents to import from, instead of reading the file.
+	const void* sourceData = NULL;
+	size_t sourceSize = 0;
+
+	// Source unit and axis system of the scene, and the matrix that converts them
+	// to the DB's.  Only applied by hand when the scene itself wasn't converted.
+	FbxSystemUnit sourceUnit;
+	FbxAxisSystem sourceAxis;
+	FbxAMatrix conversionMatrix;
+
+	// Every bone name seen, shared by all meshes.  Guarded by nameMutex while jobs run.
+	TTStringTable boneNameTable;
+	std::mutex nameMutex;
+
+	// [mesh] => bone name ids by bone Id, and the reverse.
+	std::vector<std::vector<int>> meshBones;
+	std::vector<std::unordered_map<int, int>> meshBoneIds;
 	std::map<int, std::map<int, std::string>> meshParts;
 
+	std::vector<TTNodeJob*> jobs;
+	std::map<FbxMesh*, int> meshJobs;
+	std::mutex jobMutex;
+	std::condition_variable jobDone;
+
+	// Incremental imports only: the previous import's DB, attached as "prev" and deleted
+	// once done (or restored if the import fails), and the fingerprints of its parts by [mesh, part].
+	std::wstring prevDbPath;
+	std::map<std::pair<int, int>, uint64_t> prevFingerprints;
+
+	// Prepared statements, by query string.
+	std::map<std::string, sqlite3_stmt*> statements;
+
 
-	inline bool file_exists(const std::string& name);
-	void Shutdown(int code, const char* errorMessage = NULL);
-	int GetDirectIndex(FbxMesh* mesh, FbxLayerElementTemplate<FbxVector4>* layerElement, int index_id);
-	int GetDirectIndex(FbxMesh* mesh, FbxLayerElementTemplate<FbxVector2>* layerElement, int index_id);
-	int GetDirectIndex(FbxMesh* mesh, FbxLayerElementTemplate<FbxColor>* layerElement, int index_id);
-	FbxVector4 GetPosition(FbxMesh* const mesh, int index_id);
-	FbxVector4 GetNormal(FbxMesh* const mesh, int index_id);
-	FbxVector4 GetBinormal(FbxMesh* const mesh, int index_id);
-	FbxVector4 GetTangent(FbxMesh* const mesh, int index_id);
-	FbxVector2 GetUV1(FbxMesh* const mesh, int index_id);
-	int GetUV1Index(FbxMesh* const mesh, int index_id);
-	FbxVector2 GetUV2(FbxMesh* const mesh, int index_id);
-	int GetUV2Index(FbxMesh* const mesh, int index_id);
-	FbxVector2 GetUV3(FbxMesh* const mesh, int index_id);
-	int GetUV3Index(FbxMesh* const mesh, int index_id);
-	FbxColor GetVertexColor(FbxMesh* const mesh, int index_id);
-	FbxColor GetVertexColor2(FbxMesh* const mesh, int index_id);
-	FbxColor GetVertexColor3(FbxMesh* const mesh, int index_id);
-	int GetBoneId(int mesh, std::string boneName);
+	int Shutdown(int code, const char* errorMessage = NULL);
+	void MakeLayerPlan(FbxMesh* mesh, TTLayerPlan& plan);
+	template <typename T>
+	void GatherLayer(const int* polygonVertices, int numIndices, int maxControlPoint, FbxLayerElementTemplate<T>* layerElement, const T& def, std::vector<T>& values, std::vector<int>* directIndices = NULL);
+	void GatherAttributes(FbxMesh* mesh, const TTLayerPlan& plan, TTMeshAttributes& attributes);
+	int GetBoneId(int mesh, int boneName);
+	int GetLocalBoneId(TTNodeJob* job, const char* boneName);
 	FbxSkin* GetSkin(FbxMesh* mesh);
 	FbxBlendShape* GetMorpher(FbxMesh* mesh);
 	void RunSql(sqlite3_stmt* statement);
 	void RunSql(std::string query);
 
 	sqlite3_stmt* MakeSqlStatement(std::string query);
+	sqlite3_stmt* GetStatement(const std::string& query);
+	int InitDB(sqlite3** database);
+	void AttachPreviousDB(sqlite3* database);
+	void ReleasePreviousDB(bool success);
+	bool EndBulkWrite();
+	bool SaveMemoryDb();
 	
 	bool MeshGroupExists(int mesh);
 	bool MeshPartExists(int mesh, int part);
 
 	void MakeMeshPart(int mesh, int part, std::string name, std::string parentName);
+	void WriteMeshPart(int mesh, int part, std::string name, std::string parentName, bool newMeshGroup);
 	void TestNode(FbxNode* pNode);
-	void SaveNode(FbxNode* node);
+	void QueueNode(FbxNode* node);
+	uint64_t FingerprintNode(TTNodeJob* job);
+	void ExtractNode(TTNodeJob* job);
+	bool MapPreviousBones(TTNodeJob* job, std::map<int, int>& boneMap);
+	void CopyPreviousPart(TTNodeJob* job, const std::map<int, int>& boneMap);
+	void SaveNode(TTNodeJob* job);
+	void WriteRows(int meshNum, int partNum, TTVertexBuffer& ttVertices, std::vector<int>& ttTriIndexes);
+	void WriteStreams(int meshNum, int partNum, TTVertexBuffer& ttVertices, std::vector<int>& ttTriIndexes);
+	void SaveToModel(TTNodeJob* job);
+	void RunJobs();
+	void ImportScene();
 	void WriteWarning(std::string warning);
+	FbxAMatrix GetConversionMatrix(const FbxSystemUnit& unit, const FbxAxisSystem& axis);
 
-	int Init(std::wstring fbxFilePath, sqlite3** database, FbxManager** manager, FbxScene** scene);
+	int Init(std::wstring fbxFilePath, sqlite3** database, FbxManager** manager, FbxScene** scene, FbxManager* sharedManager);
 public:
-	int ImportFBX(std::wstring fbxFile);
+	int ImportFBX(std::wstring fbxFile, TTOptions importOptions = TTOptions(), FbxManager* sharedManager = NULL);
+	int ImportModel(TTModel* target, std::wstring fbxFile, const void* data = NULL, size_t size = 0, TTOptions importOptions = TTOptions(), FbxManager* sharedManager = NULL);
 };
\ No newline at end of file
@@ -0,0 +1,104 @@
+#include <fbx_memory_stream.h>
+
+#include <cstring>
+
+TTMemoryStream::TTMemoryStream(const void* data, size_t size, int readerId) {
+	source = (const char*)data;
+	sourceSize = size;
+	this->readerId = readerId;
+}
+
+TTMemoryStream::TTMemoryStream(int writerId) {
+	this->writerId = writerId;
+}
+
+size_t TTMemoryStream::Size() const {
+	return source != NULL ? sourceSize : Buffer.size();
+}
+
+FbxStream::EState TTMemoryStream::GetState() {
+	return open ? eOpen : eClosed;
+}
+
+bool TTMemoryStream::Open(void* streamData) {
+	open = true;
+	position = 0;
+	return true;
+}
+
+bool TTMemoryStream::Close() {
+	open = false;
+	position = 0;
+	return true;
+}
+
+bool TTMemoryStream::Flush() {
+	return true;
+}
+
+// Writes at the current position, which the exporter may have moved back to patch earlier data.
+size_t TTMemoryStream::Write(const void* data, FbxUInt64 size) {
+	if (source != NULL) {
+		error = 1;
+		return 0;
+	}
+
+	if (position + size > Buffer.size()) {
+		Buffer.resize(position + size);
+	}
+	memcpy(Buffer.data() + position, data, (size_t)size);
+	position += (size_t)size;
+	return (size_t)size;
+}
+
+size_t TTMemoryStream::Read(void* data, FbxUInt64 size) const {
+	const char* bytes = source != NULL ? source : Buffer.data();
+	size_t available = Size() - position;
+	size_t count = size < available ? (size_t)size : available;
+
+	memcpy(data, bytes + position, count);
+	position += count;
+	return count;
+}
+
+int TTMemoryStream::GetReaderID() const {
+	return readerId;
+}
+
+int TTMemoryStream::GetWriterID() const {
+	return writerId;
+}
+
+void TTMemoryStream::Seek(const FbxInt64& offset, const FbxFile::ESeekPos& seekPos) {
+	FbxInt64 base = 0;
+	if (seekPos == FbxFile::eCurrent) {
+		base = position;
+	}
+	else if (seekPos == FbxFile::eEnd) {
+		base = Size();
+	}
+	SetPosition(base + offset);
+}
+
+FbxInt64 TTMemoryStream::GetPosition() const {
+	return position;
+}
+
+// Reads are clamped to the data, but writes may go past the end, so only reading streams clamp here.
+void TTMemoryStream::SetPosition(FbxInt64 newPosition) {
+	if (newPosition < 0) {
+		newPosition = 0;
+	}
+	if (source != NULL && (size_t)newPosition > sourceSize) {
+		newPosition = sourceSize;
+	}
+	position = (size_t)newPosition;
+}
+
+int TTMemoryStream::GetError() const {
+	return error;
+}
+
+void TTMemoryStream::ClearError() {
+	error = 0;
+}
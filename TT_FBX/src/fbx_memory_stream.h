@@ -0,0 +1,50 @@
+#pragma once
+
+// FBX API
+#include <fbxsdk.h>
+
+// Core
+#include <vector>
+#include <cstdint>
+
+// An FbxStream over a block of memory, so scenes can be imported from and exported
+// to buffers without going through a file.
+class TTMemoryStream : public FbxStream {
+public:
+	// Reads the given bytes, which must outlive the stream.
+	TTMemoryStream(const void* data, size_t size, int readerId);
+
+	// Writes into Buffer, which grows as needed.
+	TTMemoryStream(int writerId);
+
+	// Everything written so far.
+	std::vector<char> Buffer;
+
+	EState GetState() override;
+	bool Open(void* streamData) override;
+	bool Close() override;
+	bool Flush() override;
+	size_t Write(const void* data, FbxUInt64 size) override;
+	size_t Read(void* data, FbxUInt64 size) const override;
+	int GetReaderID() const override;
+	int GetWriterID() const override;
+	void Seek(const FbxInt64& offset, const FbxFile::ESeekPos& seekPos) override;
+	FbxInt64 GetPosition() const override;
+	void SetPosition(FbxInt64 position) override;
+	int GetError() const override;
+	void ClearError() override;
+
+private:
+	const char* source = NULL;
+	size_t sourceSize = 0;
+	int readerId = -1;
+	int writerId = -1;
+
+	bool open = false;
+
+	// The SDK reads through a const stream, yet expects the position to move.
+	mutable size_t position = 0;
+	mutable int error = 0;
+
+	size_t Size() const;
+};
@@ -0,0 +1,459 @@
+#include <tt_api.h>
+
+// Core
+#include <string>
+#include <vector>
+#include <iterator>
+#include <cstring>
+#include <memory>
+
+// Custom
+#include <tt_model.h>
+#include <fbx_importer.h>
+#include <db_converter.h>
+
+struct TTModelHandle {
+	TTModel Model;
+
+	// The last memory export.
+	std::vector<char> Fbx;
+};
+
+static TTOptions MakeOptions(const TT_Options* apiOptions) {
+	TTOptions options;
+	if (apiOptions != NULL) {
+		options.Threads = apiOptions->Threads < 0 ? 1 : apiOptions->Threads;
+		options.FuseConversion = apiOptions->FuseConversion != 0;
+		options.MaxWeights = apiOptions->MaxWeights;
+	}
+	return options;
+}
+
+static const TTMeshGroup* FindMesh(const TTModelHandle* model, int mesh) {
+	if (model == NULL || mesh < 0 || mesh >= (int)model->Model.MeshGroups.size()) {
+		return NULL;
+	}
+	return model->Model.MeshGroups[mesh];
+}
+
+static const TTPart* FindPart(const TTModelHandle* model, int mesh, int part) {
+	const TTMeshGroup* group = FindMesh(model, mesh);
+	if (group == NULL || part < 0 || part >= (int)group->Parts.size()) {
+		return NULL;
+	}
+	return group->Parts[part];
+}
+
+static const TTShapePart* FindShape(const TTModelHandle* model, int mesh, int part, int shape) {
+	const TTPart* ttPart = FindPart(model, mesh, part);
+	if (ttPart == NULL || shape < 0 || shape >= (int)ttPart->Shapes.size()) {
+		return NULL;
+	}
+	return std::next(ttPart->Shapes.begin(), shape)->second;
+}
+
+// Runs an entry point's body, turning anything it throws into the failure value,
+// as exceptions mustn't cross into the C caller.
+template <typename T, typename F>
+static T Guard(T failure, F body) {
+	try {
+		return body();
+	}
+	catch (...) {
+		return failure;
+	}
+}
+
+// Copies count values, if both sides have somewhere to copy from and to.
+template <typename T>
+static void CopyArray(T* to, const T* from, size_t count) {
+	if (to != NULL && from != NULL && count > 0) {
+		memcpy(to, from, count * sizeof(T));
+	}
+}
+
+TT_API TTModelHandle* TT_CreateModel(void) {
+	return Guard<TTModelHandle*>(NULL, [&]() -> TTModelHandle* {
+		return new TTModelHandle();
+	});
+}
+
+TT_API void TT_FreeModel(TTModelHandle* model) {
+	delete model;
+}
+
+static int ImportFbx(const wchar_t* path, const void* data, size_t size, const TT_Options* options, TTModelHandle** model) {
+	if (model == NULL || (path == NULL && data == NULL)) {
+		return TT_ERROR_INVALID_ARGUMENT;
+	}
+	if (options != NULL && (options->MaxWeights < 1 || options->MaxWeights > _TTW_Max_Weights)) {
+		return TT_ERROR_INVALID_ARGUMENT;
+	}
+
+	*model = NULL;
+	std::unique_ptr<TTModelHandle> handle(new TTModelHandle());
+	FBXImporter importer;
+	int code = importer.ImportModel(&handle->Model, path != NULL ? path : L"<memory>", data, size, MakeOptions(options));
+	if (code == 0) {
+		*model = handle.release();
+	}
+	return code;
+}
+
+TT_API int TT_ImportFbxFile(const wchar_t* path, const TT_Options* options, TTModelHandle** model) {
+	return Guard<int>(TT_ERROR_UNHANDLED, [&]() -> int {
+		return ImportFbx(path, NULL, 0, options, model);
+	});
+}
+
+TT_API int TT_ImportFbxMemory(const void* data, size_t size, const TT_Options* options, TTModelHandle** model) {
+	return Guard<int>(TT_ERROR_UNHANDLED, [&]() -> int {
+		return ImportFbx(NULL, data, size, options, model);
+	});
+}
+
+TT_API int TT_ExportFbxFile(TTModelHandle* model, const wchar_t* path) {
+	return Guard<int>(TT_ERROR_UNHANDLED, [&]() -> int {
+		if (model == NULL || path == NULL) {
+			return TT_ERROR_INVALID_ARGUMENT;
+		}
+
+		TTOptions options;
+		options.Output = path;
+
+		DBConverter converter;
+		return converter.ConvertModel(&model->Model, NULL, options);
+	});
+}
+
+TT_API int TT_ExportFbxMemory(TTModelHandle* model, size_t* size) {
+	return Guard<int>(TT_ERROR_UNHANDLED, [&]() -> int {
+		if (model == NULL || size == NULL) {
+			return TT_ERROR_INVALID_ARGUMENT;
+		}
+
+		model->Fbx.clear();
+		DBConverter converter;
+		int code = converter.ConvertModel(&model->Model, &model->Fbx);
+		*size = model->Fbx.size();
+		return code;
+	});
+}
+
+TT_API int TT_CopyFbx(const TTModelHandle* model, void* buffer, size_t capacity) {
+	return Guard<int>(TT_ERROR_UNHANDLED, [&]() -> int {
+		if (model == NULL || buffer == NULL) {
+			return TT_ERROR_INVALID_ARGUMENT;
+		}
+		if (capacity < model->Fbx.size()) {
+			return TT_ERROR_BUFFER_TOO_SMALL;
+		}
+		CopyArray((char*)buffer, model->Fbx.data(), model->Fbx.size());
+		return 0;
+	});
+}
+
+TT_API int TT_GetMeshCount(const TTModelHandle* model) {
+	return Guard<int>(0, [&]() -> int {
+		return model != NULL ? (int)model->Model.MeshGroups.size() : 0;
+	});
+}
+
+TT_API const char* TT_GetMeshName(const TTModelHandle* model, int mesh) {
+	return Guard<const char*>(NULL, [&]() -> const char* {
+		const TTMeshGroup* group = FindMesh(model, mesh);
+		return group != NULL ? group->Name.c_str() : NULL;
+	});
+}
+
+TT_API int TT_GetMeshBoneCount(const TTModelHandle* model, int mesh) {
+	return Guard<int>(0, [&]() -> int {
+		const TTMeshGroup* group = FindMesh(model, mesh);
+		return group != NULL ? (int)group->Bones.size() : 0;
+	});
+}
+
+TT_API const char* TT_GetMeshBoneName(const TTModelHandle* model, int mesh, int bone) {
+	return Guard<const char*>(NULL, [&]() -> const char* {
+		const TTMeshGroup* group = FindMesh(model, mesh);
+		if (group == NULL || bone < 0 || bone >= (int)group->Bones.size() || group->Bones[bone] < 0) {
+			return NULL;
+		}
+		return model->Model.Names.Get(group->Bones[bone]).c_str();
+	});
+}
+
+TT_API int TT_GetPartCount(const TTModelHandle* model, int mesh) {
+	return Guard<int>(0, [&]() -> int {
+		const TTMeshGroup* group = FindMesh(model, mesh);
+		return group != NULL ? (int)group->Parts.size() : 0;
+	});
+}
+
+TT_API const char* TT_GetPartName(const TTModelHandle* model, int mesh, int part) {
+	return Guard<const char*>(NULL, [&]() -> const char* {
+		const TTPart* ttPart = FindPart(model, mesh, part);
+		return ttPart != NULL ? ttPart->Name.c_str() : NULL;
+	});
+}
+
+TT_API int TT_GetPartData(const TTModelHandle* model, int mesh, int part, TT_PartBuffers* buffers) {
+	return Guard<int>(TT_ERROR_UNHANDLED, [&]() -> int {
+		const TTPart* ttPart = FindPart(model, mesh, part);
+		if (ttPart == NULL || buffers == NULL) {
+			return TT_ERROR_INVALID_ARGUMENT;
+		}
+
+		const TTVertexBuffer& vertices = ttPart->Vertices;
+		size_t count = vertices.Size();
+		buffers->VertexCount = (int)count;
+		buffers->IndexCount = (int)ttPart->Indices.size();
+
+		CopyArray(buffers->Positions, vertices.Positions.data(), count * 3);
+		CopyArray(buffers->Normals, vertices.Normals.data(), count * 3);
+		CopyArray(buffers->Binormals, vertices.Binormals.data(), count * 3);
+		CopyArray(buffers->Tangents, vertices.Tangents.data(), count * 3);
+		for (int i = 0; i < 3; i++) {
+			CopyArray(buffers->UVs[i], vertices.UVs[i].data(), count * 2);
+		}
+		for (int i = 0; i < 2; i++) {
+			CopyArray(buffers->Colors[i], vertices.Colors[i].data(), count * 4);
+		}
+		CopyArray(buffers->Flow, vertices.Flow.data(), count * 2);
+		CopyArray(buffers->BoneIds, vertices.BoneIds.data(), count * _TTW_Max_Weights);
+		CopyArray(buffers->Weights, vertices.Weights.data(), count * _TTW_Max_Weights);
+		CopyArray(buffers->Indices, ttPart->Indices.data(), ttPart->Indices.size());
+		return 0;
+	});
+}
+
+TT_API int TT_GetShapeCount(const TTModelHandle* model, int mesh, int part) {
+	return Guard<int>(0, [&]() -> int {
+		const TTPart* ttPart = FindPart(model, mesh, part);
+		return ttPart != NULL ? (int)ttPart->Shapes.size() : 0;
+	});
+}
+
+TT_API const char* TT_GetShapeName(const TTModelHandle* model, int mesh, int part, int shape) {
+	return Guard<const char*>(NULL, [&]() -> const char* {
+		const TTShapePart* ttShape = FindShape(model, mesh, part, shape);
+		return ttShape != NULL ? ttShape->Name.c_str() : NULL;
+	});
+}
+
+TT_API int TT_GetShapeVertexCount(const TTModelHandle* model, int mesh, int part, int shape) {
+	return Guard<int>(0, [&]() -> int {
+		const TTShapePart* ttShape = FindShape(model, mesh, part, shape);
+		return ttShape != NULL ? (int)ttShape->VertexReplacements.size() : 0;
+	});
+}
+
+TT_API int TT_GetShapeData(const TTModelHandle* model, int mesh, int part, int shape, int* vertexIds, float* positions) {
+	return Guard<int>(TT_ERROR_UNHANDLED, [&]() -> int {
+		const TTShapePart* ttShape = FindShape(model, mesh, part, shape);
+		if (ttShape == NULL) {
+			return TT_ERROR_INVALID_ARGUMENT;
+		}
+
+		int i = 0;
+		for (auto it = ttShape->VertexReplacements.begin(); it != ttShape->VertexReplacements.end(); ++it, i++) {
+			if (vertexIds != NULL) {
+				vertexIds[i] = it->first;
+			}
+			if (positions != NULL) {
+				for (int c = 0; c < 3; c++) {
+					positions[i * 3 + c] = (float)it->second[c];
+				}
+			}
+		}
+		return 0;
+	});
+}
+
+TT_API int TT_GetWarningCount(const TTModelHandle* model) {
+	return Guard<int>(0, [&]() -> int {
+		return model != NULL ? (int)model->Model.Warnings.size() : 0;
+	});
+}
+
+TT_API const char* TT_GetWarning(const TTModelHandle* model, int warning) {
+	return Guard<const char*>(NULL, [&]() -> const char* {
+		if (model == NULL || warning < 0 || warning >= (int)model->Model.Warnings.size()) {
+			return NULL;
+		}
+		return model->Model.Warnings[warning].c_str();
+	});
+}
+
+TT_API int TT_SetModelInfo(TTModelHandle* model, const char* rootName, const char* units) {
+	return Guard<int>(TT_ERROR_UNHANDLED, [&]() -> int {
+		if (model == NULL) {
+			return TT_ERROR_INVALID_ARGUMENT;
+		}
+		if (rootName != NULL) {
+			model->Model.RootName = rootName;
+			for (unsigned int i = 0; i < model->Model.ModelNames.size(); i++) {
+				model->Model.ModelNames[i] = rootName;
+			}
+		}
+		if (units != NULL) {
+			model->Model.Units = units;
+		}
+		return 0;
+	});
+}
+
+TT_API int TT_AddMesh(TTModelHandle* model, const char* name, int materialId, int* mesh) {
+	return Guard<int>(TT_ERROR_UNHANDLED, [&]() -> int {
+		if (model == NULL || materialId < 0) {
+			return TT_ERROR_INVALID_ARGUMENT;
+		}
+
+		int meshId = (int)model->Model.MeshGroups.size();
+		TTMeshGroup* group = model->Model.GetMeshGroup(meshId);
+		group->Name = name != NULL ? name : "";
+		group->MaterialId = materialId;
+
+		if (mesh != NULL) {
+			*mesh = meshId;
+		}
+		return 0;
+	});
+}
+
+TT_API int TT_SetMeshBones(TTModelHandle* model, int mesh, const char* const* names, int count) {
+	return Guard<int>(TT_ERROR_UNHANDLED, [&]() -> int {
+		if (FindMesh(model, mesh) == NULL || count < 0 || (count > 0 && names == NULL)) {
+			return TT_ERROR_INVALID_ARGUMENT;
+		}
+
+		TTMeshGroup* group = model->Model.MeshGroups[mesh];
+		group->Bones.assign(count, -1);
+		for (int i = 0; i < count; i++) {
+			if (names[i] != NULL) {
+				group->Bones[i] = model->Model.Names.Intern(names[i]);
+			}
+		}
+		return 0;
+	});
+}
+
+TT_API int TT_AddPart(TTModelHandle* model, int mesh, const char* name, const TT_PartBuffers* buffers, int* part) {
+	return Guard<int>(TT_ERROR_UNHANDLED, [&]() -> int {
+		if (FindMesh(model, mesh) == NULL || buffers == NULL || buffers->VertexCount < 0 || buffers->IndexCount < 0) {
+			return TT_ERROR_INVALID_ARGUMENT;
+		}
+		if (buffers->IndexCount > 0 && buffers->Indices == NULL) {
+			return TT_ERROR_INVALID_ARGUMENT;
+		}
+		for (int i = 0; i < buffers->IndexCount; i++) {
+			if (buffers->Indices[i] < 0 || buffers->Indices[i] >= buffers->VertexCount) {
+				return TT_ERROR_INVALID_ARGUMENT;
+			}
+		}
+
+		int partId = (int)model->Model.MeshGroups[mesh]->Parts.size();
+		TTPart* ttPart = model->Model.GetPart(mesh, partId);
+		ttPart->Name = name != NULL ? name : "";
+
+		TTVertexBuffer& vertices = ttPart->Vertices;
+		size_t count = buffers->VertexCount;
+		vertices.Resize((int)count);
+
+		CopyArray(vertices.Positions.data(), buffers->Positions, count * 3);
+		CopyArray(vertices.Normals.data(), buffers->Normals, count * 3);
+		CopyArray(vertices.Binormals.data(), buffers->Binormals, count * 3);
+		CopyArray(vertices.Tangents.data(), buffers->Tangents, count * 3);
+		for (int i = 0; i < 3; i++) {
+			CopyArray(vertices.UVs[i].data(), buffers->UVs[i], count * 2);
+		}
+		for (int i = 0; i < 2; i++) {
+			CopyArray(vertices.Colors[i].data(), buffers->Colors[i], count * 4);
+		}
+		CopyArray(vertices.Flow.data(), buffers->Flow, count * 2);
+		CopyArray(vertices.BoneIds.data(), buffers->BoneIds, count * _TTW_Max_Weights);
+		CopyArray(vertices.Weights.data(), buffers->Weights, count * _TTW_Max_Weights);
+
+		ttPart->Indices.assign(buffers->Indices, buffers->Indices + buffers->IndexCount);
+
+		if (part != NULL) {
+			*part = partId;
+		}
+		return 0;
+	});
+}
+
+TT_API int TT_AddShape(TTModelHandle* model, int mesh, int part, const char* name, int count, const int* vertexIds, const float* positions) {
+	return Guard<int>(TT_ERROR_UNHANDLED, [&]() -> int {
+		if (FindPart(model, mesh, part) == NULL || name == NULL || count < 0 || (count > 0 && (vertexIds == NULL || positions == NULL))) {
+			return TT_ERROR_INVALID_ARGUMENT;
+		}
+
+		TTPart* ttPart = model->Model.MeshGroups[mesh]->Parts[part];
+		TTShapePart*& shape = ttPart->Shapes[name];
+		if (shape == NULL) {
+			shape = new TTShapePart();
+			shape->Name = name;
+		}
+
+		shape->VertexReplacements.clear();
+		for (int i = 0; i < count; i++) {
+			const float* position = &positions[i * 3];
+			shape->VertexReplacements[vertexIds[i]] = FbxVector4(position[0], position[1], position[2], 1);
+		}
+		return 0;
+	});
+}
+
+TT_API int TT_AddBone(TTModelHandle* model, const char* name, const char* parentName, const double* matrix) {
+	return Guard<int>(TT_ERROR_UNHANDLED, [&]() -> int {
+		if (model == NULL || name == NULL || matrix == NULL) {
+			return TT_ERROR_INVALID_ARGUMENT;
+		}
+
+		TTModel& ttModel = model->Model;
+		TTBone* bone = new TTBone();
+		bone->Name = ttModel.Names.Intern(name);
+		bone->ParentName = parentName != NULL && parentName[0] != '\0' ? ttModel.Names.Intern(parentName) : -1;
+
+		Eigen::Matrix4d baseMatrix;
+		for (int row = 0; row < 4; row++) {
+			for (int col = 0; col < 4; col++) {
+				baseMatrix(row, col) = matrix[row * 4 + col];
+			}
+		}
+		bone->PoseMatrix.matrix() = baseMatrix;
+		ttModel.Bones.push_back(bone);
+
+		// The skeleton is reassembled from the bone list on the next export.
+		ttModel.FullSkeleton = NULL;
+		for (unsigned int i = 0; i < ttModel.Bones.size(); i++) {
+			ttModel.Bones[i]->Children.clear();
+		}
+		ttModel.IndexSkeleton();
+		return 0;
+	});
+}
+
+TT_API int TT_AddMaterial(TTModelHandle* model, const TT_Material* material, int* materialId) {
+	return Guard<int>(TT_ERROR_UNHANDLED, [&]() -> int {
+		if (model == NULL || material == NULL) {
+			return TT_ERROR_INVALID_ARGUMENT;
+		}
+
+		TTMaterial* ttMaterial = new TTMaterial();
+		int id = (int)model->Model.Materials.size();
+		ttMaterial->Name = material->Name != NULL ? material->Name : "Material " + std::to_string(id);
+		ttMaterial->Diffuse = material->Diffuse != NULL ? material->Diffuse : "";
+		ttMaterial->Normal = material->Normal != NULL ? material->Normal : "";
+		ttMaterial->Specular = material->Specular != NULL ? material->Specular : "";
+		ttMaterial->Opacity = material->Opacity != NULL ? material->Opacity : "";
+		ttMaterial->Emissive = material->Emissive != NULL ? material->Emissive : "";
+		model->Model.Materials.push_back(ttMaterial);
+
+		if (materialId != NULL) {
+			*materialId = id;
+		}
+		return 0;
+	});
+}
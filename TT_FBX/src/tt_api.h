@@ -0,0 +1,121 @@
+#pragma once
+
+// C interface to the converter, for loading it in-process as a DLL.
+// Models are passed across as flat arrays in buffers the caller owns, so nothing
+// has to go through a DB file.  Functions that return int return the same status
+// codes the converter exits with, 0 being success.  Nothing is ever thrown across;
+// getters return 0 or NULL if something goes wrong inside.
+
+#include <stddef.h>
+#include <wchar.h>
+
+#ifdef TT_FBX_EXPORTS
+#define TT_API __declspec(dllexport)
+#else
+#define TT_API __declspec(dllimport)
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Bad handle, index or buffer passed in.
+#define TT_ERROR_INVALID_ARGUMENT 108
+
+// The caller's buffer is too small.
+#define TT_ERROR_BUFFER_TOO_SMALL 109
+
+// Something unexpected went wrong inside the converter.  Matches _TT_Unhandled_Error.
+#define TT_ERROR_UNHANDLED 999
+
+// Matches _TTW_Max_Weights and _TTW_No_Bone.
+#define TT_MAX_WEIGHTS 8
+#define TT_NO_BONE 0xFFFF
+
+typedef struct TTModelHandle TTModelHandle;
+
+// Import settings.  A NULL TT_Options* uses the defaults.
+typedef struct TT_Options {
+	int Threads;            // 1 = serial, 0 = one per core.
+	int FuseConversion;     // Non-zero to fold the unit/axis conversion into each mesh's transform.
+	int MaxWeights;         // 1 - 8.
+} TT_Options;
+
+// A part's vertex and index arrays, in the same layout the converter keeps them in.
+// When reading, any array left NULL is skipped; when adding, it's left at zero (no bones).
+typedef struct TT_PartBuffers {
+	int VertexCount;
+	int IndexCount;
+
+	float* Positions;               // xyz
+	float* Normals;                 // xyz
+	float* Binormals;               // xyz
+	float* Tangents;                // xyz
+	float* UVs[3];                  // uv
+	unsigned char* Colors[2];       // rgba, 0-255
+	float* Flow;                    // uv, -1 to 1
+	unsigned short* BoneIds;        // TT_MAX_WEIGHTS per vertex, indices into the mesh's bones, TT_NO_BONE if unused
+	unsigned short* Weights;        // TT_MAX_WEIGHTS per vertex, 0-65535
+	int* Indices;                   // 3 per triangle
+} TT_PartBuffers;
+
+typedef struct TT_Material {
+	const char* Name;
+	const char* Diffuse;
+	const char* Normal;
+	const char* Specular;
+	const char* Opacity;
+	const char* Emissive;
+} TT_Material;
+
+// Model lifetime.
+TT_API TTModelHandle* TT_CreateModel(void);
+TT_API void TT_FreeModel(TTModelHandle* model);
+
+// FBX -> model.  The new model is returned in *model, and must be freed by the caller.
+TT_API int TT_ImportFbxFile(const wchar_t* path, const TT_Options* options, TTModelHandle** model);
+TT_API int TT_ImportFbxMemory(const void* data, size_t size, const TT_Options* options, TTModelHandle** model);
+
+// Model -> FBX.  A memory export is kept on the model, *size gives its length,
+// and TT_CopyFbx copies it out into the caller's buffer.
+TT_API int TT_ExportFbxFile(TTModelHandle* model, const wchar_t* path);
+TT_API int TT_ExportFbxMemory(TTModelHandle* model, size_t* size);
+TT_API int TT_CopyFbx(const TTModelHandle* model, void* buffer, size_t capacity);
+
+// Reading a model.  Counts are 0 for anything out of range.
+// Strings belong to the model, and last until it's changed or freed.
+TT_API int TT_GetMeshCount(const TTModelHandle* model);
+TT_API const char* TT_GetMeshName(const TTModelHandle* model, int mesh);
+TT_API int TT_GetMeshBoneCount(const TTModelHandle* model, int mesh);
+TT_API const char* TT_GetMeshBoneName(const TTModelHandle* model, int mesh, int bone);
+TT_API int TT_GetPartCount(const TTModelHandle* model, int mesh);
+TT_API const char* TT_GetPartName(const TTModelHandle* model, int mesh, int part);
+
+// Fills in the part's counts, and copies its arrays into whichever buffers are set.
+// Call with every array NULL first to get the counts to size the buffers by.
+TT_API int TT_GetPartData(const TTModelHandle* model, int mesh, int part, TT_PartBuffers* buffers);
+
+TT_API int TT_GetShapeCount(const TTModelHandle* model, int mesh, int part);
+TT_API const char* TT_GetShapeName(const TTModelHandle* model, int mesh, int part, int shape);
+TT_API int TT_GetShapeVertexCount(const TTModelHandle* model, int mesh, int part, int shape);
+
+// Copies a shape's moved vertices: their ids in the part, and new xyz positions.
+TT_API int TT_GetShapeData(const TTModelHandle* model, int mesh, int part, int shape, int* vertexIds, float* positions);
+
+TT_API int TT_GetWarningCount(const TTModelHandle* model);
+TT_API const char* TT_GetWarning(const TTModelHandle* model, int warning);
+
+// Building a model.  New meshes and parts are numbered in the order they're added.
+TT_API int TT_SetModelInfo(TTModelHandle* model, const char* rootName, const char* units);
+TT_API int TT_AddMesh(TTModelHandle* model, const char* name, int materialId, int* mesh);
+TT_API int TT_SetMeshBones(TTModelHandle* model, int mesh, const char* const* names, int count);
+TT_API int TT_AddPart(TTModelHandle* model, int mesh, const char* name, const TT_PartBuffers* buffers, int* part);
+TT_API int TT_AddShape(TTModelHandle* model, int mesh, int part, const char* name, int count, const int* vertexIds, const float* positions);
+
+// Matrix is the bone's 4x4 pose matrix, row by row.  A NULL or empty parent makes it the root.
+TT_API int TT_AddBone(TTModelHandle* model, const char* name, const char* parentName, const double* matrix);
+TT_API int TT_AddMaterial(TTModelHandle* model, const TT_Material* material, int* materialId);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,19 @@
+#pragma once
+
+// Core
+#include <stdexcept>
+#include <string>
+
+// A critical error that ends the current conversion.
+// Thrown wherever the converters used to exit() on the spot.  ImportFBX/ConvertDB catch it,
+// clean up through Shutdown() and return Code, which means the same as the old exit codes did.
+class TTError : public std::runtime_error {
+public:
+	int Code;
+
+	TTError(int code, const std::string& message = "") : std::runtime_error(message), Code(code) {}
+};
+
+// Code returned for any other exception.  The converters catch those too, so the modes
+// that keep the process running (server, batch, the library) always get a status back.
+#define _TT_Unhandled_Error 999
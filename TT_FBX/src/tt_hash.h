@@ -0,0 +1,140 @@
+#pragma once
+
+// Core
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <string>
+#include <algorithm>
+
+// Streaming 64-bit xxHash (XXH64).  Fast enough to hash whole input files
+// without it showing up next to the conversion itself.
+class TTHash64 {
+public:
+	TTHash64(uint64_t seed = 0) {
+		v[0] = seed + Prime1 + Prime2;
+		v[1] = seed + Prime2;
+		v[2] = seed;
+		v[3] = seed - Prime1;
+		this->seed = seed;
+	}
+
+	void Update(const void* data, size_t size) {
+		const uint8_t* p = (const uint8_t*)data;
+		total += size;
+
+		// Top up a partial stripe left over from the last update first.
+		if (buffered > 0) {
+			size_t take = std::min(size, sizeof(buffer) - buffered);
+			memcpy(buffer + buffered, p, take);
+			buffered += take;
+			p += take;
+			size -= take;
+			if (buffered < sizeof(buffer)) {
+				return;
+			}
+			Stripe(buffer);
+			buffered = 0;
+		}
+
+		while (size >= sizeof(buffer)) {
+			Stripe(p);
+			p += sizeof(buffer);
+			size -= sizeof(buffer);
+		}
+
+		memcpy(buffer, p, size);
+		buffered = size;
+	}
+
+	// Hashes a value's bytes as they sit in memory.  Only meant for plain numbers.
+	template <typename T>
+	void UpdateValue(const T& value) {
+		Update(&value, sizeof(T));
+	}
+
+	void UpdateString(const std::string& value) {
+		UpdateValue((uint64_t)value.size());
+		Update(value.data(), value.size());
+	}
+
+	uint64_t Digest() const {
+		uint64_t h;
+		if (total >= sizeof(buffer)) {
+			h = Rotl(v[0], 1) + Rotl(v[1], 7) + Rotl(v[2], 12) + Rotl(v[3], 18);
+			for (int i = 0; i < 4; i++) {
+				h ^= Round(0, v[i]);
+				h = h * Prime1 + Prime4;
+			}
+		}
+		else {
+			h = seed + Prime5;
+		}
+		h += total;
+
+		const uint8_t* p = buffer;
+		size_t size = buffered;
+		while (size >= 8) {
+			h ^= Round(0, Read64(p));
+			h = Rotl(h, 27) * Prime1 + Prime4;
+			p += 8;
+			size -= 8;
+		}
+		if (size >= 4) {
+			uint32_t k;
+			memcpy(&k, p, 4);
+			h ^= k * Prime1;
+			h = Rotl(h, 23) * Prime2 + Prime3;
+			p += 4;
+			size -= 4;
+		}
+		while (size > 0) {
+			h ^= *p * Prime5;
+			h = Rotl(h, 11) * Prime1;
+			p++;
+			size--;
+		}
+
+		h ^= h >> 33;
+		h *= Prime2;
+		h ^= h >> 29;
+		h *= Prime3;
+		h ^= h >> 32;
+		return h;
+	}
+
+private:
+	static const uint64_t Prime1 = 0x9E3779B185EBCA87ULL;
+	static const uint64_t Prime2 = 0xC2B2AE3D27D4EB4FULL;
+	static const uint64_t Prime3 = 0x165667B19E3779F9ULL;
+	static const uint64_t Prime4 = 0x85EBCA77C2B2AE63ULL;
+	static const uint64_t Prime5 = 0x27D4EB2F165667C5ULL;
+
+	uint64_t v[4];
+	uint64_t seed;
+	uint64_t total = 0;
+	uint8_t buffer[32];
+	size_t buffered = 0;
+
+	static uint64_t Rotl(uint64_t x, int r) {
+		return (x << r) | (x >> (64 - r));
+	}
+
+	static uint64_t Read64(const uint8_t* p) {
+		uint64_t x;
+		memcpy(&x, p, 8);
+		return x;
+	}
+
+	static uint64_t Round(uint64_t acc, uint64_t input) {
+		acc += input * Prime2;
+		acc = Rotl(acc, 31);
+		return acc * Prime1;
+	}
+
+	void Stripe(const uint8_t* p) {
+		for (int i = 0; i < 4; i++) {
+			v[i] = Round(v[i], Read64(p + i * 8));
+		}
+	}
+};
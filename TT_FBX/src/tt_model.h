@@ -2,129 +2,253 @@
 
 #include <fbxsdk.h>
 #include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <unordered_map>
+#include <deque>
+#include <string_view>
+#include <cstdint>
+#include <cstring>
 
 #include <eigen>
 #define _TTW_Max_Weights 8
 
-// An individual TTWeight
-struct TTWeight {
-    int BoneId;
-    double Weight;
-};
+// Marks an unused weight slot in a TTVertexBuffer.
+#define _TTW_No_Bone 0xFFFF
 
-// Struct representing a set of weights on a TTVertex
-struct TTWeightSet {
+// A part's vertices, stored one array per attribute at about the precision the game itself uses.
+// The FBX SDK works in doubles, so values are only converted to and from its types at the
+// edges, through the Get/Set helpers below.
+class TTVertexBuffer {
 public:
-    TTWeight Weights[_TTW_Max_Weights];
-
-    friend bool operator==(const TTWeightSet& lhs, const TTWeightSet& rhs)
-    {
-        for (int i = 0; i < _TTW_Max_Weights; i++) {
-            if (lhs.Weights[i].Weight != 0) {
-                if (lhs.Weights[i].Weight != rhs.Weights[i].Weight) return false;
-                if (lhs.Weights[i].BoneId != rhs.Weights[i].BoneId) return false;
-            }
-        }
-        return true;
+    std::vector<float> Positions;       // xyz
+    std::vector<float> Normals;         // xyz
+    std::vector<float> Binormals;       // xyz
+    std::vector<float> Tangents;        // xyz
+    std::vector<float> UVs[3];          // uv
+    std::vector<uint8_t> Colors[2];     // rgba, 0-255
+    std::vector<float> Flow;            // uv, -1 to 1
+    std::vector<uint16_t> BoneIds;      // _TTW_Max_Weights per vertex, _TTW_No_Bone if unused
+    std::vector<uint16_t> Weights;      // _TTW_Max_Weights per vertex, 0-65535
+
+    int Size() const {
+        return count;
     }
 
-    void Add(int boneId, double weight) {
-        int idx = -1;
-        int usedWeights = 0;
-        for (int i = 0; i < _TTW_Max_Weights; i++) {
-            if (Weights[i].BoneId == -1) {
-                idx = i;
-                break;
-            }
-            usedWeights++;
-        }
+    // Resizes every array.  New vertices are zeroed, with no bones.
+    void Resize(int size) {
+        count = size;
+        Positions.resize(size * 3);
+        Normals.resize(size * 3);
+        Binormals.resize(size * 3);
+        Tangents.resize(size * 3);
+        for (int i = 0; i < 3; i++) UVs[i].resize(size * 2);
+        for (int i = 0; i < 2; i++) Colors[i].resize(size * 4);
+        Flow.resize(size * 2);
+        BoneIds.resize(size * _TTW_Max_Weights, _TTW_No_Bone);
+        Weights.resize(size * _TTW_Max_Weights);
+    }
 
-        // We are already at max weights.  We must decide if one should be replaced.
-        if (usedWeights == 4) {
+    void Reserve(int size) {
+        Positions.reserve(size * 3);
+        Normals.reserve(size * 3);
+        Binormals.reserve(size * 3);
+        Tangents.reserve(size * 3);
+        for (int i = 0; i < 3; i++) UVs[i].reserve(size * 2);
+        for (int i = 0; i < 2; i++) Colors[i].reserve(size * 4);
+        Flow.reserve(size * 2);
+        BoneIds.reserve(size * _TTW_Max_Weights);
+        Weights.reserve(size * _TTW_Max_Weights);
+    }
 
-            int minWeightIdx = -1;
-            double minWeight = 999;
+    FbxVector4 GetPosition(int i) const { return GetVector(Positions, i); }
+    FbxVector4 GetNormal(int i) const { return GetVector(Normals, i); }
+    FbxVector4 GetBinormal(int i) const { return GetVector(Binormals, i); }
+    FbxVector4 GetTangent(int i) const { return GetVector(Tangents, i); }
+    void SetPosition(int i, const FbxVector4& value) { SetVector(Positions, i, value); }
+    void SetNormal(int i, const FbxVector4& value) { SetVector(Normals, i, value); }
+    void SetBinormal(int i, const FbxVector4& value) { SetVector(Binormals, i, value); }
+    void SetTangent(int i, const FbxVector4& value) { SetVector(Tangents, i, value); }
+
+    FbxVector2 GetUV(int channel, int i) const {
+        const float* uv = &UVs[channel][i * 2];
+        return FbxVector2(uv[0], uv[1]);
+    }
 
-            for (int i = 0; i < _TTW_Max_Weights; i++) {
-                if (Weights[i].Weight < minWeight || minWeightIdx == -1) {
-                    minWeight = Weights[i].Weight;
-                    minWeightIdx = i;
-                }
-            }
+    void SetUV(int channel, int i, const FbxVector2& value) {
+        float* uv = &UVs[channel][i * 2];
+        uv[0] = (float)value[0];
+        uv[1] = (float)value[1];
+    }
 
-            // Our new weight is heavier than the lightest weight.  Replace the lightest.
-            if (weight > minWeight) {
-                idx = minWeightIdx;
-            }
+    FbxColor GetColor(int channel, int i) const {
+        const uint8_t* c = &Colors[channel][i * 4];
+        return FbxColor(c[0] / 255.0, c[1] / 255.0, c[2] / 255.0, c[3] / 255.0);
+    }
+
+    void SetColor(int channel, int i, const FbxColor& value) {
+        uint8_t* c = &Colors[channel][i * 4];
+        const double rgba[4] = { value.mRed, value.mGreen, value.mBlue, value.mAlpha };
+        for (int ci = 0; ci < 4; ci++) {
+            c[ci] = PackUnorm8(rgba[ci]);
         }
+    }
+
+    // Flow is carried in FBX files as the red and green of the third vertex color channel.
+    FbxColor GetFlowColor(int i) const {
+        const float* f = &Flow[i * 2];
+        return FbxColor((f[0] + 1) / 2.0, (f[1] + 1) / 2.0, 1, 1);
+    }
+
+    void SetFlowColor(int i, const FbxColor& value) {
+        float* f = &Flow[i * 2];
+        f[0] = (float)(value.mRed * 2 - 1.0);
+        f[1] = (float)(value.mGreen * 2 - 1.0);
+    }
 
-        if (idx < 0) {
+    // Bone id in the given weight slot, or -1 if the slot is unused.
+    int GetBoneId(int i, int slot) const {
+        uint16_t id = BoneIds[i * _TTW_Max_Weights + slot];
+        return id == _TTW_No_Bone ? -1 : id;
+    }
+
+    double GetWeight(int i, int slot) const {
+        return Weights[i * _TTW_Max_Weights + slot] / 65535.0;
+    }
+
+    // Negative bone ids clear the slot.  Weights are clamped to 0-1.
+    void SetWeight(int i, int slot, int boneId, double weight) {
+        int w = i * _TTW_Max_Weights + slot;
+        if (boneId < 0 || boneId >= _TTW_No_Bone) {
+            BoneIds[w] = _TTW_No_Bone;
+            Weights[w] = 0;
             return;
         }
+        BoneIds[w] = (uint16_t)boneId;
+        Weights[w] = PackUnorm16(weight);
+    }
+
+    // 0-1 to 0-255, clamped.
+    static uint8_t PackUnorm8(double value) {
+        return (uint8_t)(std::min(std::max(value, 0.0), 1.0) * 255.0 + 0.5);
+    }
+
+    // 0-1 to 0-65535, clamped.  Every 8-bit value lands exactly on a 16-bit one.
+    static uint16_t PackUnorm16(double value) {
+        return (uint16_t)(std::min(std::max(value, 0.0), 1.0) * 65535.0 + 0.5);
+    }
 
-        Weights[idx].BoneId = boneId;
-        Weights[idx].Weight = weight;
+private:
+    int count = 0;
 
+    static FbxVector4 GetVector(const std::vector<float>& values, int i) {
+        const float* v = &values[i * 3];
+        return FbxVector4(v[0], v[1], v[2]);
     }
 
-    TTWeightSet() {
-        for (int i = 0; i < _TTW_Max_Weights; i++) {
-            Weights[i].BoneId = -1;
-            Weights[i].Weight = 0;
+    static void SetVector(std::vector<float>& values, int i, const FbxVector4& value) {
+        float* v = &values[i * 3];
+        v[0] = (float)value[0];
+        v[1] = (float)value[1];
+        v[2] = (float)value[2];
+    }
+};
+
+// Canonical bit pattern of one vertex in a TTVertexBuffer, used to hash vertices for de-duplication.
+// Two keys compare equal exactly when every stored attribute compares equal, along with the
+// UV indices the vertex was read from.
+// Weights are left out, since every vertex sharing a control point shares its weight set.
+struct TTVertexKey {
+    static const int _Words = 25;
+
+    uint32_t Bits[_Words];
+    uint64_t Hash;
+
+    // Set if any attribute is NaN; such a vertex never compares equal to anything.
+    bool Unique;
+
+    TTVertexKey(const TTVertexBuffer& b, int v, const int uvIndices[3]) {
+        int w = 0;
+        Unique = false;
+        for (int i = 0; i < 3; i++) Bits[w++] = Canonical(b.Positions[v * 3 + i]);
+        for (int i = 0; i < 3; i++) Bits[w++] = Canonical(b.Normals[v * 3 + i]);
+        for (int i = 0; i < 3; i++) Bits[w++] = Canonical(b.Binormals[v * 3 + i]);
+        for (int i = 0; i < 3; i++) Bits[w++] = Canonical(b.Tangents[v * 3 + i]);
+        for (int c = 0; c < 3; c++) {
+            for (int i = 0; i < 2; i++) Bits[w++] = Canonical(b.UVs[c][v * 2 + i]);
+        }
+        for (int i = 0; i < 2; i++) Bits[w++] = Canonical(b.Flow[v * 2 + i]);
+        for (int c = 0; c < 2; c++) {
+            memcpy(&Bits[w++], &b.Colors[c][v * 4], 4);
+        }
+        for (int c = 0; c < 3; c++) Bits[w++] = (uint32_t)uvIndices[c];
+
+        Hash = 14695981039346656037ULL;
+        for (int i = 0; i < _Words; i++) {
+            Hash ^= Bits[i];
+            Hash *= 0xff51afd7ed558ccdULL;
+            Hash ^= Hash >> 32;
         }
     }
 
+    friend bool operator== (const TTVertexKey& a, const TTVertexKey& b) {
+        if (a.Unique || b.Unique || a.Hash != b.Hash) return false;
+        return memcmp(a.Bits, b.Bits, sizeof(a.Bits)) == 0;
+    }
 
-    friend bool operator!=(const TTWeightSet& lhs, const TTWeightSet& rhs)
-    {
-        return !(lhs == rhs);
+private:
+    // -0.0 and 0.0 compare equal as floats, so they share a pattern.
+    uint32_t Canonical(float f) {
+        uint32_t bits = 0;
+        if (f != f) {
+            Unique = true;
+        }
+        else if (f != 0) {
+            memcpy(&bits, &f, sizeof(float));
+        }
+        return bits;
     }
 };
 
-// A fully qualified TT Vertex.
-class TTVertex {
+// Stores each distinct string once, and hands out small integer ids for them.
+// Ids are dense and assigned in first-use order, so they can index plain vectors.
+class TTStringTable {
 public:
+    // Gets the id of the given string, adding it if it's new.
+    int Intern(std::string_view value) {
+        auto it = ids.find(value);
+        if (it != ids.end()) {
+            return it->second;
+        }
+
+        int id = (int)strings.size();
+        strings.emplace_back(value);
+        ids.emplace(strings.back(), id);
+        return id;
+    }
+
+    // Gets the id of the given string, or -1 if it was never added.
+    int Find(std::string_view value) const {
+        auto it = ids.find(value);
+        if (it == ids.end()) {
+            return -1;
+        }
+        return it->second;
+    }
+
+    const std::string& Get(int id) const {
+        return strings[id];
+    }
+
+    int Size() const {
+        return (int)strings.size();
+    }
 
-    FbxVector4 Position;
-    FbxVector4 Normal;
-    FbxVector4 Binormal;
-    FbxVector4 Tangent;
-    FbxVector2 UV1;
-    FbxVector2 UV2;
-    FbxVector2 UV3;
-    FbxColor VertexColor;
-    FbxColor VertexColor2;
-    FbxColor VertexColor3;
-    TTWeightSet WeightSet;
-
-    int UV1Index;
-    int UV2Index;
-    int UV3Index;
-
-
-    // Overload equality to test memberwise.
-    friend bool operator== (const TTVertex& a, const TTVertex& b) {
-        if (a.Position != b.Position) return false;
-        if (a.Normal != b.Normal) return false;
-        if (a.Binormal != b.Binormal) return false;
-        if (a.Tangent != b.Tangent) return false;
-        if (a.UV1 != b.UV1) return false;
-        if (a.UV2 != b.UV2) return false;
-        if (a.UV3 != b.UV3) return false;
-        if (a.VertexColor != b.VertexColor) return false;
-        if (a.VertexColor2 != b.VertexColor2) return false;
-        if (a.VertexColor3 != b.VertexColor3) return false;
-        if (a.WeightSet != b.WeightSet) return false;
-
-        // Compare UVs by index as well.
-        if (a.UV1Index != b.UV1Index) return false;
-        if (a.UV2Index != b.UV2Index) return false;
-        if (a.UV3Index != b.UV3Index) return false;
-
-
-
-        return true;
-    };
+private:
+    // A deque never moves its elements, so the views keying ids stay valid.
+    std::deque<std::string> strings;
+    std::unordered_map<std::string_view, int> ids;
 };
 
 class TTMeshPart;
@@ -132,16 +256,17 @@ class TTMeshGroup;
 class TTModel;
 
 // Model Level Skeleton Information
+// Names are ids in TTModel::Names.
 class TTBone {
 public:
-    std::string Name;
-    std::string ParentName;
+    int Name;
+    int ParentName = -1;
 
-    TTBone* Parent;
+    TTBone* Parent = NULL;
     std::vector<TTBone*> Children;
 
     Eigen::Transform<double, 3, Eigen::Affine> PoseMatrix;
-    FbxNode* Node;
+    FbxNode* Node = NULL;
 };
 
 class TTMaterial {
@@ -159,8 +284,9 @@ class TTShapePart {
 public:
     std::string Name;
 
-    // Maps original part vertex ID to new replacement vertex.
-    std::map<int, TTVertex> VertexReplacements;
+    // Maps original part vertex ID to its new position.
+    // Everything else about the vertex is the same as the base part's.
+    std::map<int, FbxVector4> VertexReplacements;
 };
 
 class TTPart {
@@ -168,10 +294,10 @@ public:
     std::string Name;
     int PartId;
     std::map<std::string, TTShapePart*> Shapes;
-    std::vector<TTVertex> Vertices;
+    TTVertexBuffer Vertices;
     std::vector<int> Indices;
-    FbxNode* Node;
-    TTMeshGroup* MeshGroup;
+    FbxNode* Node = NULL;
+    TTMeshGroup* MeshGroup = NULL;
 };
 
 
@@ -179,18 +305,20 @@ class TTMeshGroup {
 public:
     std::string Name;
     std::vector<TTPart*> Parts;
-    std::vector<std::string> Bones;
-    int MeshId;
-    int MaterialId;
-    FbxNode* Node;
-    TTModel* Model;
+
+    // Bone names by bone id, as ids in TTModel::Names.  -1 for gaps.
+    std::vector<int> Bones;
+    int MeshId = 0;
+    int MaterialId = 0;
+    FbxNode* Node = NULL;
+    TTModel* Model = NULL;
 
     // Basic hack workaround for changing child name prefixes.
     // Not sure if we'll ever need more than one TTModel object
     // in a scene, but if we do this will be changed to key to the 
     // actual TTModel entry, and a TTScene parent class for
     // TTModel should be generated.
-    int ModelNameId;
+    int ModelNameId = 0;
 };
 
 class TTModel {
@@ -205,9 +333,18 @@ public:
     // The overall root name that should be used for FBX scene.
     std::string RootName;
 
-    TTBone* FullSkeleton;
+    // Every bone read for the model, whether or not it made it into FullSkeleton.
+    std::vector<TTBone*> Bones;
+
+    TTBone* FullSkeleton = NULL;
     FbxNode* Node;
 
+    // Every bone name used by the model.
+    TTStringTable Names;
+
+    // Name id => bone for every bone in FullSkeleton, NULL for other names.  Built by IndexSkeleton().
+    std::vector<TTBone*> BoneIndex;
+
     // Unit information  'meter', 'inch', 'centimeter' etc.
     std::string Units;
 
@@ -226,23 +363,83 @@ public:
     // Application version number
     std::string Version;
 
-    TTBone* GetBone(std::string name, TTBone* parent = NULL) {
-        if (parent == NULL) {
-            parent = FullSkeleton;
+    // Warnings raised while the model was imported, when it wasn't imported into a DB.
+    std::vector<std::string> Warnings;
+
+    // The model owns everything it points to, save for the FBX objects.
+    ~TTModel() {
+        for (unsigned int mi = 0; mi < MeshGroups.size(); mi++) {
+            TTMeshGroup* group = MeshGroups[mi];
+            for (unsigned int pi = 0; pi < group->Parts.size(); pi++) {
+                TTPart* part = group->Parts[pi];
+                for (auto it = part->Shapes.begin(); it != part->Shapes.end(); ++it) {
+                    delete it->second;
+                }
+                delete part;
+            }
+            delete group;
         }
 
-        if (parent->Name == name) {
-            return parent;
+        for (unsigned int i = 0; i < Materials.size(); i++) {
+            delete Materials[i];
         }
 
-        for (int i = 0; i < parent->Children.size(); i++) {
-            TTBone* r = GetBone(name, parent->Children[i]);
-            if (r != NULL) {
-                return r;
-            }
+        for (unsigned int i = 0; i < Bones.size(); i++) {
+            delete Bones[i];
+        }
+    }
+
+    // Gets the given mesh group, adding empty groups up to it as needed.
+    TTMeshGroup* GetMeshGroup(int meshId) {
+        while (meshId >= (int)MeshGroups.size()) {
+            TTMeshGroup* group = new TTMeshGroup();
+            group->Model = this;
+            group->MeshId = (int)MeshGroups.size();
+            MeshGroups.push_back(group);
+        }
+        return MeshGroups[meshId];
+    }
+
+    // Gets the given part, adding empty parts (and groups) up to it as needed.
+    TTPart* GetPart(int meshId, int partId) {
+        TTMeshGroup* group = GetMeshGroup(meshId);
+        while (partId >= (int)group->Parts.size()) {
+            TTPart* part = new TTPart();
+            part->MeshGroup = group;
+            part->PartId = (int)group->Parts.size();
+            group->Parts.push_back(part);
+        }
+        return group->Parts[partId];
+    }
+
+    TTBone* GetBone(int name) {
+        if (name < 0 || name >= (int)BoneIndex.size()) {
+            return NULL;
         }
+        return BoneIndex[name];
+    }
 
-        return NULL;
+    // Rebuilds BoneIndex from FullSkeleton.
+    // Bones are visited in the same order the old recursive search used, so if a name
+    // somehow shows up twice, the first one in the tree still wins.
+    void IndexSkeleton() {
+        BoneIndex.assign(Names.Size(), NULL);
+        if (FullSkeleton == NULL) {
+            return;
+        }
 
+        std::vector<TTBone*> stack;
+        stack.push_back(FullSkeleton);
+        while (!stack.empty()) {
+            TTBone* bone = stack.back();
+            stack.pop_back();
+            if (bone->Name >= 0 && bone->Name < (int)BoneIndex.size() && BoneIndex[bone->Name] == NULL) {
+                BoneIndex[bone->Name] = bone;
+            }
+
+            for (int i = (int)bone->Children.size() - 1; i >= 0; i--) {
+                stack.push_back(bone->Children[i]);
+            }
+        }
     }
 };
\ No newline at end of file
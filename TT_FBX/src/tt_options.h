@@ -0,0 +1,144 @@
+#pragma once
+
+// Core
+#include <string>
+#include <cwchar>
+#include <cstdlib>
+#include <cerrno>
+#include <climits>
+
+// Settings for a single conversion, parsed from the optional arguments
+// that follow the input file path.
+class TTOptions {
+public:
+
+	// Number of worker threads used to extract mesh nodes on FBX import.
+	// 1 keeps the original serial behavior, 0 uses one thread per core.
+	int Threads = 1;
+
+	// Skip converting the whole scene to meters/Y-up on FBX import, and fold the
+	// conversion into each mesh's world transform instead.
+	bool FuseConversion = false;
+
+	// Build the DB in memory on FBX import, and write it to disk in one go at the end.
+	bool MemoryDb = false;
+
+	// Write vertex data to the columnar streams table on FBX import, rather than the indices/vertices tables.
+	bool ColumnarDb = false;
+
+	// Most bone weights kept per vertex on FBX import, 1 - 8.  The heaviest are kept.
+	int MaxWeights = 8;
+
+	// File to write the result to.  Empty writes result.db or result.fbx to the working directory.
+	std::wstring Output;
+
+	// Batch mode only: directory the results go to, named after each input.  Empty uses the working directory.
+	std::wstring OutputDir;
+
+	// Batch mode only: number of files converted at once.  0 uses one per core.
+	int Jobs = 0;
+
+	// Directory of earlier results to reuse, keyed by the input file's contents.  Empty turns caching off.
+	std::wstring CacheDir;
+
+	// Size the cache is trimmed to, in MB.  The least recently used results go first.
+	int CacheSize = 1024;
+
+	// Hardlink cached results into place rather than copying them.
+	bool CacheLink = false;
+
+	// Keep the existing output DB on FBX import, and copy over any part whose geometry
+	// hasn't changed since it was written, rather than extracting it again.
+	bool Incremental = false;
+
+	// Parses a whole argument as a base 10 int.  Returns false if it's empty,
+	// has anything after the number, or doesn't fit in an int.
+	static bool ParseInt(const wchar_t* text, int& value) {
+		wchar_t* end = NULL;
+		errno = 0;
+		long parsed = std::wcstol(text, &end, 10);
+		if (end == text || *end != L'\0' || errno == ERANGE || parsed < INT_MIN || parsed > INT_MAX) {
+			return false;
+		}
+		value = (int)parsed;
+		return true;
+	}
+
+	// Parses the option arguments starting at argv[start].
+	// Returns false if an unknown or malformed option was supplied.
+	bool Parse(int argc, wchar_t* argv[], int start) {
+		for (int i = start; i < argc; i++) {
+			std::wstring arg = argv[i];
+
+			if (arg == L"--threads" || arg == L"-t") {
+				if (i + 1 >= argc) {
+					return false;
+				}
+				if (!ParseInt(argv[++i], Threads) || Threads < 0) {
+					return false;
+				}
+			}
+			else if (arg == L"--fuse-conversion") {
+				FuseConversion = true;
+			}
+			else if (arg == L"--memory-db") {
+				MemoryDb = true;
+			}
+			else if (arg == L"--columnar-db") {
+				ColumnarDb = true;
+			}
+			else if (arg == L"--max-weights") {
+				if (i + 1 >= argc) {
+					return false;
+				}
+				if (!ParseInt(argv[++i], MaxWeights) || MaxWeights < 1 || MaxWeights > 8) {
+					return false;
+				}
+			}
+			else if (arg == L"--output" || arg == L"-o") {
+				if (i + 1 >= argc) {
+					return false;
+				}
+				Output = argv[++i];
+			}
+			else if (arg == L"--out-dir") {
+				if (i + 1 >= argc) {
+					return false;
+				}
+				OutputDir = argv[++i];
+			}
+			else if (arg == L"--jobs" || arg == L"-j") {
+				if (i + 1 >= argc) {
+					return false;
+				}
+				if (!ParseInt(argv[++i], Jobs) || Jobs < 0) {
+					return false;
+				}
+			}
+			else if (arg == L"--cache") {
+				if (i + 1 >= argc) {
+					return false;
+				}
+				CacheDir = argv[++i];
+			}
+			else if (arg == L"--cache-size") {
+				if (i + 1 >= argc) {
+					return false;
+				}
+				if (!ParseInt(argv[++i], CacheSize) || CacheSize < 1) {
+					return false;
+				}
+			}
+			else if (arg == L"--cache-link") {
+				CacheLink = true;
+			}
+			else if (arg == L"--incremental") {
+				Incremental = true;
+			}
+			else {
+				return false;
+			}
+		}
+		return true;
+	}
+};
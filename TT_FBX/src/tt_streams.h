@@ -0,0 +1,217 @@
+#pragma once
+
+// Core
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+// Custom
+#include <tt_model.h>
+
+// The meta table's schema_version from which vertex data lives in the streams table,
+// rather than the indices/vertices tables.
+#define _TT_Streams_Schema_Version 2
+
+// The streams each part's vertex data is split into.
+enum TTStreamType {
+	eStreamIndices,
+	eStreamPosition,
+	eStreamNormal,
+	eStreamBinormal,
+	eStreamTangent,
+	eStreamColor,
+	eStreamColor2,
+	eStreamUV1,
+	eStreamUV2,
+	eStreamUV3,
+	eStreamFlow,
+	eStreamBoneIds,
+	eStreamBoneWeights,
+	eStreamCount
+};
+
+// Name and element size of a stream.  Every component is 4 bytes, little-endian:
+// int32 for indices and bone ids, float32 for everything else.
+struct TTStreamLayout {
+	const char* Name;
+	int Components;
+	bool Integer;
+};
+
+static const TTStreamLayout _TT_Stream_Layouts[eStreamCount] = {
+	{ "indices",		1,					true },
+	{ "position",		3,					false },
+	{ "normal",			3,					false },
+	{ "binormal",		3,					false },
+	{ "tangent",		3,					false },
+	{ "color",			4,					false },
+	{ "color2",			4,					false },
+	{ "uv_1",			2,					false },
+	{ "uv_2",			2,					false },
+	{ "uv_3",			2,					false },
+	{ "flow",			2,					false },
+	{ "bone_ids",		_TTW_Max_Weights,	true },
+	{ "bone_weights",	_TTW_Max_Weights,	false },
+};
+
+// Gets the stream with the given name, or -1 if there isn't one.
+inline int GetStreamType(const char* name) {
+	for (int i = 0; i < eStreamCount; i++) {
+		if (strcmp(_TT_Stream_Layouts[i].Name, name) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+inline void PutStreamInt(unsigned char*& out, int32_t value) {
+	uint32_t bits = (uint32_t)value;
+	out[0] = (unsigned char)bits;
+	out[1] = (unsigned char)(bits >> 8);
+	out[2] = (unsigned char)(bits >> 16);
+	out[3] = (unsigned char)(bits >> 24);
+	out += 4;
+}
+
+inline void PutStreamFloat(unsigned char*& out, double value) {
+	float f = (float)value;
+	uint32_t bits;
+	memcpy(&bits, &f, 4);
+	PutStreamInt(out, (int32_t)bits);
+}
+
+inline int32_t GetStreamInt(const unsigned char*& in) {
+	uint32_t bits = (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+	in += 4;
+	return (int32_t)bits;
+}
+
+inline double GetStreamFloat(const unsigned char*& in) {
+	uint32_t bits = (uint32_t)GetStreamInt(in);
+	float f;
+	memcpy(&f, &bits, 4);
+	return f;
+}
+
+// The buffer array a float stream maps onto one to one, or NULL if the stream needs converting.
+template <typename TBuffer>
+inline auto GetFloatStreamArray(TBuffer& vertices, int s) -> decltype(&vertices.Positions) {
+	switch (s) {
+	case eStreamPosition:	return &vertices.Positions;
+	case eStreamNormal:		return &vertices.Normals;
+	case eStreamBinormal:	return &vertices.Binormals;
+	case eStreamTangent:	return &vertices.Tangents;
+	case eStreamUV1:		return &vertices.UVs[0];
+	case eStreamUV2:		return &vertices.UVs[1];
+	case eStreamUV3:		return &vertices.UVs[2];
+	case eStreamFlow:		return &vertices.Flow;
+	}
+	return NULL;
+}
+
+/**
+ * Packs a part's indices and vertices into one blob per stream.
+ * Values are stored the same way as the vertices table columns; unused weight slots get bone id -1.
+ */
+inline void PackStreams(const TTVertexBuffer& vertices, const std::vector<int>& indices, std::vector<unsigned char> streams[eStreamCount]) {
+	int vertexCount = vertices.Size();
+	for (int s = 0; s < eStreamCount; s++) {
+		size_t count = s == eStreamIndices ? indices.size() : vertexCount;
+		streams[s].resize(count * _TT_Stream_Layouts[s].Components * 4);
+		unsigned char* out = streams[s].data();
+
+		if (s == eStreamIndices) {
+			for (size_t i = 0; i < indices.size(); i++) {
+				PutStreamInt(out, indices[i]);
+			}
+			continue;
+		}
+
+		const std::vector<float>* values = GetFloatStreamArray(vertices, s);
+		if (values != NULL) {
+			for (size_t i = 0; i < values->size(); i++) {
+				PutStreamFloat(out, (*values)[i]);
+			}
+			continue;
+		}
+
+		switch (s) {
+		case eStreamColor:
+		case eStreamColor2: {
+			const std::vector<uint8_t>& colors = vertices.Colors[s == eStreamColor ? 0 : 1];
+			for (size_t i = 0; i < colors.size(); i++) PutStreamFloat(out, colors[i] / 255.0);
+			break;
+		}
+		case eStreamBoneIds:
+			for (int i = 0; i < vertexCount; i++) {
+				for (int c = 0; c < _TTW_Max_Weights; c++) PutStreamInt(out, vertices.GetBoneId(i, c));
+			}
+			break;
+		case eStreamBoneWeights:
+			for (int i = 0; i < vertexCount; i++) {
+				for (int c = 0; c < _TTW_Max_Weights; c++) PutStreamFloat(out, vertices.GetWeight(i, c));
+			}
+			break;
+		}
+	}
+}
+
+/**
+ * Unpacks one stream blob into a part's indices or vertices.
+ * The vertex buffer must already hold count vertices.  Bone id -1 marks an empty weight slot.
+ * Returns false if the blob doesn't hold count elements.
+ */
+inline bool UnpackStream(int s, const unsigned char* in, int bytes, int count, TTVertexBuffer& vertices, std::vector<int>& indices) {
+	if (s < 0 || s >= eStreamCount || count < 0 || bytes != count * _TT_Stream_Layouts[s].Components * 4) {
+		return false;
+	}
+
+	if (s == eStreamIndices) {
+		indices.resize(count);
+		for (int i = 0; i < count; i++) {
+			indices[i] = GetStreamInt(in);
+		}
+		return true;
+	}
+
+	if (vertices.Size() < count) {
+		return false;
+	}
+
+	std::vector<float>* values = GetFloatStreamArray(vertices, s);
+	if (values != NULL) {
+		int n = count * _TT_Stream_Layouts[s].Components;
+		for (int i = 0; i < n; i++) {
+			(*values)[i] = (float)GetStreamFloat(in);
+		}
+		return true;
+	}
+
+	switch (s) {
+	case eStreamColor:
+	case eStreamColor2: {
+		std::vector<uint8_t>& colors = vertices.Colors[s == eStreamColor ? 0 : 1];
+		for (int i = 0; i < count * 4; i++) {
+			colors[i] = TTVertexBuffer::PackUnorm8(GetStreamFloat(in));
+		}
+		break;
+	}
+	case eStreamBoneIds:
+		// Weights come in their own stream, so keep whatever is already in the slot.
+		for (int i = 0; i < count; i++) {
+			for (int c = 0; c < _TTW_Max_Weights; c++) {
+				int id = GetStreamInt(in);
+				vertices.BoneIds[i * _TTW_Max_Weights + c] = id >= 0 && id < _TTW_No_Bone ? (uint16_t)id : _TTW_No_Bone;
+			}
+		}
+		break;
+	case eStreamBoneWeights:
+		for (int i = 0; i < count; i++) {
+			for (int c = 0; c < _TTW_Max_Weights; c++) {
+				vertices.Weights[i * _TTW_Max_Weights + c] = TTVertexBuffer::PackUnorm16(GetStreamFloat(in));
+			}
+		}
+		break;
+	}
+	return true;
+}
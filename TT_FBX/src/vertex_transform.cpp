@@ -0,0 +1,104 @@
+#include <vertex_transform.h>
+
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// MSVC lets us use the AVX2 intrinsics anywhere; GCC/Clang need the functions tagged.
+#if defined(__GNUC__)
+#define TT_AVX2_TARGET __attribute__((target("avx2,fma")))
+#else
+#define TT_AVX2_TARGET
+#endif
+
+typedef void (*TransformKernel)(const TTVertexTransform& transform, const FbxVector4* input, FbxVector4* output, int count, bool normalize);
+
+/**
+ * Scalar fallback.  Exactly the old per-vertex MultT + Normalize path.
+ */
+static void TransformScalar(const TTVertexTransform& transform, const FbxVector4* input, FbxVector4* output, int count, bool normalize) {
+	for (int i = 0; i < count; i++) {
+		output[i] = transform.Matrix.MultT(input[i]);
+		if (normalize) {
+			output[i].Normalize();
+		}
+	}
+}
+
+/**
+ * AVX2 kernel.  One FbxVector4 is four doubles, so each vector fits a single register.
+ */
+TT_AVX2_TARGET static void TransformAVX2(const TTVertexTransform& transform, const FbxVector4* input, FbxVector4* output, int count, bool normalize) {
+	const __m256d constant = _mm256_loadu_pd(transform.Constant.mData);
+	const __m256d basisX = _mm256_loadu_pd(transform.Basis[0].mData);
+	const __m256d basisY = _mm256_loadu_pd(transform.Basis[1].mData);
+	const __m256d basisZ = _mm256_loadu_pd(transform.Basis[2].mData);
+	const __m256d basisW = _mm256_loadu_pd(transform.Basis[3].mData);
+	const __m256d zero = _mm256_setzero_pd();
+
+	for (int i = 0; i < count; i++) {
+		const double* v = input[i].mData;
+
+		__m256d result = _mm256_fmadd_pd(_mm256_broadcast_sd(&v[0]), basisX, constant);
+		result = _mm256_fmadd_pd(_mm256_broadcast_sd(&v[1]), basisY, result);
+		result = _mm256_fmadd_pd(_mm256_broadcast_sd(&v[2]), basisZ, result);
+		result = _mm256_fmadd_pd(_mm256_broadcast_sd(&v[3]), basisW, result);
+
+		if (normalize) {
+			// Length over X/Y/Z, summed in the same order as FbxVector4::Length().
+			__m256d squared = _mm256_blend_pd(_mm256_mul_pd(result, result), zero, 0x8);
+			__m256d pairs = _mm256_hadd_pd(squared, squared);
+			__m128d sum = _mm_add_sd(_mm256_castpd256_pd128(pairs), _mm256_extractf128_pd(pairs, 1));
+			double length = _mm_cvtsd_f64(_mm_sqrt_sd(sum, sum));
+
+			if (length != 0) {
+				__m256d scaled = _mm256_div_pd(result, _mm256_set1_pd(length));
+				result = _mm256_blend_pd(scaled, result, 0x8);
+			}
+		}
+
+		_mm256_storeu_pd(output[i].mData, result);
+	}
+}
+
+static bool CpuSupportsAVX2() {
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) {
+		return false;
+	}
+
+	// FMA, OSXSAVE and AVX, and the OS has to be saving the YMM registers.
+	__cpuid(info, 1);
+	const int fma = 1 << 12;
+	const int osxsave = 1 << 27;
+	const int avx = 1 << 28;
+	if ((info[2] & (fma | osxsave | avx)) != (fma | osxsave | avx)) {
+		return false;
+	}
+	if ((_xgetbv(0) & 0x6) != 0x6) {
+		return false;
+	}
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+
+static TransformKernel GetKernel() {
+	static const TransformKernel kernel = CpuSupportsAVX2() ? TransformAVX2 : TransformScalar;
+	return kernel;
+}
+
+void TTVertexTransform::Transform(const FbxVector4* input, FbxVector4* output, int count, bool normalize) const {
+	GetKernel()(*this, input, output, count, normalize);
+}
+
+bool TTVertexTransform::UsingAVX2() {
+	return GetKernel() == TransformAVX2;
+}
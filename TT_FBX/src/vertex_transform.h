@@ -0,0 +1,55 @@
+#pragma once
+
+// FBX API
+#include <fbxsdk.h>
+
+// Core
+#include <vector>
+
+// Batched FbxAMatrix::MultT for whole arrays of vectors, with optional
+// normalization of the result.
+//
+// Uses an AVX2/FMA kernel when the CPU supports it, and plain MultT/Normalize
+// otherwise.  The AVX2 kernel computes each component as one chain of fused
+// multiply-adds, so it can differ from MultT in the last bits.  Tolerance is
+// 8 ULP of the largest of the terms summed to make a component, and 32 ULP of
+// 1.0 (about 7e-15) for normalized vectors.  Normalization itself works the
+// same way Normalize() does (X/Y/Z only, zero length vectors left alone).
+class TTVertexTransform {
+public:
+
+	// The matrix being applied.
+	FbxAMatrix Matrix;
+
+	// The matrix broken down as Out = Constant + X * Basis[0] + Y * Basis[1] + Z * Basis[2] + W * Basis[3].
+	FbxVector4 Constant;
+	FbxVector4 Basis[4];
+
+	TTVertexTransform() {}
+	TTVertexTransform(const FbxAMatrix& matrix) {
+		SetMatrix(matrix);
+	}
+
+	// Sets the matrix to apply.
+	// The basis is read back out of MultT itself, so the kernel uses exactly
+	// the same row/column and W conventions the SDK does.
+	void SetMatrix(const FbxAMatrix& matrix) {
+		Matrix = matrix;
+		Constant = Matrix.MultT(FbxVector4(0, 0, 0, 0));
+		for (int i = 0; i < 4; i++) {
+			FbxVector4 axis(0, 0, 0, 0);
+			axis[i] = 1.0;
+			Basis[i] = Matrix.MultT(axis) - Constant;
+		}
+	}
+
+	// Transforms count vectors from input into output.  The two may be the same array.
+	void Transform(const FbxVector4* input, FbxVector4* output, int count, bool normalize) const;
+
+	void Transform(std::vector<FbxVector4>& vectors, bool normalize) const {
+		Transform(vectors.data(), vectors.data(), (int)vectors.size(), normalize);
+	}
+
+	// True if the AVX2 kernel is in use on this CPU.
+	static bool UsingAVX2();
+};
@@ -0,0 +1,138 @@
+#include <weight_accumulator.h>
+
+#include <cfloat>
+#include <cmath>
+#include <emmintrin.h>
+
+// Each control point's slots are handled as two SSE registers.
+static_assert(_TTW_Max_Weights == 8, "TTWeightAccumulator assumes 8 weight slots.");
+
+TTWeightAccumulator::TTWeightAccumulator(int controlPointCount, int maxInfluences) {
+	if (maxInfluences < 1) maxInfluences = 1;
+	if (maxInfluences > _TTW_Max_Weights) maxInfluences = _TTW_Max_Weights;
+
+	this->controlPointCount = controlPointCount;
+	this->maxInfluences = maxInfluences;
+
+	weights.assign(controlPointCount * _TTW_Max_Weights, 0);
+	boneIds.assign(controlPointCount * _TTW_Max_Weights, -1);
+	truncated.assign(controlPointCount, 0);
+	quantized.assign(controlPointCount * _TTW_Max_Weights, 0);
+
+	if (maxInfluences < _TTW_Max_Weights) {
+		for (int cp = 0; cp < controlPointCount; cp++) {
+			for (int slot = maxInfluences; slot < _TTW_Max_Weights; slot++) {
+				weights[cp * _TTW_Max_Weights + slot] = FLT_MAX;
+			}
+		}
+	}
+}
+
+void TTWeightAccumulator::Add(int controlPoint, int boneId, float weight) {
+	float* w = &weights[controlPoint * _TTW_Max_Weights];
+
+	// Find the lightest slot; empty slots count as weight 0, so they're used up first.
+	__m128 lo = _mm_loadu_ps(w);
+	__m128 hi = _mm_loadu_ps(w + 4);
+	__m128 lightest = _mm_min_ps(lo, hi);
+	lightest = _mm_min_ps(lightest, _mm_shuffle_ps(lightest, lightest, _MM_SHUFFLE(2, 3, 0, 1)));
+	lightest = _mm_min_ps(lightest, _mm_shuffle_ps(lightest, lightest, _MM_SHUFFLE(1, 0, 3, 2)));
+
+	float lightestWeight = _mm_cvtss_f32(lightest);
+	if (lightestWeight > 0) {
+		truncated[controlPoint] = 1;
+	}
+	if (weight <= lightestWeight) {
+		return;
+	}
+
+	// First slot holding the lightest weight.
+	int mask = _mm_movemask_ps(_mm_cmpeq_ps(lo, lightest)) | (_mm_movemask_ps(_mm_cmpeq_ps(hi, lightest)) << 4);
+	int slot = 0;
+	while (!(mask & 1)) {
+		mask >>= 1;
+		slot++;
+	}
+
+	w[slot] = weight;
+	boneIds[controlPoint * _TTW_Max_Weights + slot] = boneId;
+}
+
+void TTWeightAccumulator::Normalize(Report& report, const int* polyStart) {
+	// Masks off the FLT_MAX padding past maxInfluences.
+	alignas(16) int keep[_TTW_Max_Weights];
+	for (int slot = 0; slot < _TTW_Max_Weights; slot++) {
+		keep[slot] = slot < maxInfluences ? -1 : 0;
+	}
+	const __m128 keepLo = _mm_castsi128_ps(_mm_load_si128((const __m128i*)keep));
+	const __m128 keepHi = _mm_castsi128_ps(_mm_load_si128((const __m128i*)(keep + 4)));
+
+	bool first = true;
+	for (int cp = 0; cp < controlPointCount; cp++) {
+		// Orphaned points never become vertices, so there's nothing to fix or report.
+		if (polyStart != NULL && polyStart[cp + 1] == polyStart[cp]) {
+			continue;
+		}
+
+		const float* w = &weights[cp * _TTW_Max_Weights];
+		__m128 lo = _mm_and_ps(_mm_loadu_ps(w), keepLo);
+		__m128 hi = _mm_and_ps(_mm_loadu_ps(w + 4), keepHi);
+
+		__m128 sum = _mm_add_ps(lo, hi);
+		sum = _mm_add_ps(sum, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(2, 3, 0, 1)));
+		sum = _mm_add_ps(sum, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 0, 3, 2)));
+		float total = _mm_cvtss_f32(sum);
+
+		if (truncated[cp]) {
+			report.Truncated++;
+		}
+
+		if (total <= 0) {
+			report.Unweighted++;
+			continue;
+		}
+
+		if (first || total < report.MinSum) report.MinSum = total;
+		if (first || total > report.MaxSum) report.MaxSum = total;
+		first = false;
+		if (std::fabs(total - 1.0) > _TTW_Sum_Tolerance) {
+			report.Renormalized++;
+		}
+
+		// Scale to 0-255 and round to nearest.
+		__m128 scale = _mm_set1_ps(255.0f / total);
+		alignas(16) int q[_TTW_Max_Weights];
+		_mm_store_si128((__m128i*)q, _mm_cvtps_epi32(_mm_mul_ps(lo, scale)));
+		_mm_store_si128((__m128i*)(q + 4), _mm_cvtps_epi32(_mm_mul_ps(hi, scale)));
+
+		// Rounding can leave the total a few steps off 255.  The heaviest weight
+		// takes up the difference, since it is the one that changes least by it.
+		int qTotal = 0;
+		int heaviest = 0;
+		for (int slot = 0; slot < _TTW_Max_Weights; slot++) {
+			qTotal += q[slot];
+			if (q[slot] > q[heaviest]) heaviest = slot;
+		}
+		q[heaviest] += 255 - qTotal;
+
+		uint8_t* out = &quantized[cp * _TTW_Max_Weights];
+		for (int slot = 0; slot < _TTW_Max_Weights; slot++) {
+			out[slot] = (uint8_t)q[slot];
+		}
+	}
+}
+
+void TTWeightAccumulator::CopyTo(int controlPoint, TTVertexBuffer& vertices, int vertex) const {
+	const uint8_t* q = &quantized[controlPoint * _TTW_Max_Weights];
+	const int* ids = &boneIds[controlPoint * _TTW_Max_Weights];
+
+	int used = 0;
+	for (int slot = 0; slot < maxInfluences; slot++) {
+		if (q[slot] > 0) {
+			vertices.SetWeight(vertex, used++, ids[slot], q[slot] / 255.0);
+		}
+	}
+	while (used < _TTW_Max_Weights) {
+		vertices.SetWeight(vertex, used++, -1, 0);
+	}
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+// Core
+#include <vector>
+#include <cstdint>
+
+// Custom
+#include <tt_model.h>
+
+// Half a step of the game's 8-bit weight precision.
+// Control points whose weights sum further than this from 1 are reported.
+#define _TTW_Sum_Tolerance (0.5 / 255.0)
+
+// Gathers the skin weights of every control point in a mesh in one pass over its clusters,
+// keeping only the heaviest few per point.  Normalize() then scales each point's weights
+// to sum to 1 and quantizes them to the 8 bits the game stores them with.
+class TTWeightAccumulator {
+public:
+
+	// What Normalize() found, counted in control points.
+	class Report {
+	public:
+		// No weights at all.
+		int Unweighted = 0;
+
+		// Weights summed to more than _TTW_Sum_Tolerance away from 1.
+		int Renormalized = 0;
+
+		// More weights than the influence limit; the lightest were dropped.
+		int Truncated = 0;
+
+		// Lowest and highest weight sums seen, before normalization.
+		double MinSum = 1;
+		double MaxSum = 1;
+	};
+
+	// maxInfluences is clamped to 1 - _TTW_Max_Weights.
+	TTWeightAccumulator(int controlPointCount, int maxInfluences);
+
+	// Adds a weight to a control point.  Once the point is full, the weight
+	// replaces the lightest one held if it is heavier.
+	void Add(int controlPoint, int boneId, float weight);
+
+	// Normalizes and quantizes every control point's weights.
+	// If polyStart is given (control point => first tri index, in CSR form, as ExtractNode builds it),
+	// control points no triangle uses are skipped, and left out of the report.
+	void Normalize(Report& report, const int* polyStart = NULL);
+
+	// Copies a control point's finished weights into a vertex, packed into the first
+	// slots in the order they were filled.  Weights that quantized to 0 are left out.
+	void CopyTo(int controlPoint, TTVertexBuffer& vertices, int vertex) const;
+
+private:
+	int controlPointCount;
+	int maxInfluences;
+
+	// _TTW_Max_Weights slots per control point.  Empty slots hold weight 0 and bone -1.
+	// Slots past maxInfluences hold FLT_MAX, so the lightest-slot search never picks them.
+	std::vector<float> weights;
+	std::vector<int> boneIds;
+	std::vector<uint8_t> truncated;
+
+	// Weights out of 255, filled by Normalize().
+	std::vector<uint8_t> quantized;
+};